@@ -0,0 +1,51 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "material.hpp"
+#include "scene.hpp"
+
+// the scenes from examples/, without their cameras and output, for benchmarking
+// materials are kept in materials, since the scene only holds pointers to them
+
+inline void cornell_box(Scene& scene, std::vector<std::unique_ptr<Material>>& materials) {
+    scene.add_light(std::make_unique<AreaLight>(
+        std::make_unique<Quad>(Pt3(-1.f, 1.9999f, -4.f), Vec3(0.f, 0.f, -2.f), Vec3(2.f, 0.f, 0.f)),
+        spectra::ILLUM_D65(),
+        12.0f,
+        false
+    ));
+    auto diffuse = [&](float r, float g, float b) {
+        materials.push_back(std::make_unique<DiffuseMaterial>(SolidColor(r, g, b)));
+        return materials.back().get();
+    };
+    scene.add_quad(Pt3(-2.f, 2.f, -7.f), Pt3(2.f, 2.f, -7.f), Pt3(2.f, 2.f, -3.f), Pt3(-2.f, 2.f, -3.f), diffuse(0.8f, 0.4f, 0.1f));
+    scene.add_quad(Pt3(-2.f, -2.f, -3.f), Pt3(2.f, -2.f, -3.f), Pt3(2.f, -2.f, -7.f), Pt3(-2.f, -2.f, -7.f), diffuse(0.1f, 0.6f, 0.8f));
+    scene.add_quad(Pt3(-2.f, -2.f, -3.f), Pt3(-2.f, -2.f, -7.f), Pt3(-2.f, 2.f, -7.f), Pt3(-2.f, 2.f, -3.f), diffuse(0.8f, 0.0f, 0.1f));
+    scene.add_quad(Pt3(2.f, -2.f, -3.f), Pt3(2.f, 2.f, -3.f), Pt3(2.f, 2.f, -7.f), Pt3(2.f, -2.f, -7.f), diffuse(0.1f, 0.1f, 0.8f));
+    scene.add_quad(Pt3(-2.f, -2.f, -7.f), Pt3(2.f, -2.f, -7.f), Pt3(2.f, 2.f, -7.f), Pt3(-2.f, 2.f, -7.f), diffuse(0.1f, 0.8f, 0.1f));
+    materials.push_back(std::make_unique<DielectricMaterial>(std::make_shared<RGBUnboundedSpectrum>(RGB(1.1f, 1.8f, 3.0f))));
+    scene.add_sphere(Pt3(-0.8f, -1.25f, -4.4f), 0.75f, materials.back().get());
+    materials.push_back(std::make_unique<ConductiveMaterial>(ConductiveMaterial::copper(0.1, 0.06)));
+    scene.add_sphere(Pt3(0.6f, -1.0f, -5.5f), 1.0f, materials.back().get());
+}
+
+inline void glass_spheres(Scene& scene, std::vector<std::unique_ptr<Material>>& materials) {
+    scene.add_light(std::make_unique<AreaLight>(
+        std::make_unique<Quad>(Pt3(-3.f, -3.f, -12.f), Vec3(6.f, 0.f, 0.f), Vec3(0.f, 6.f, 0.f)),
+        spectra::ILLUM_D65(),
+        8.0f,
+        false
+    ));
+    materials.push_back(std::make_unique<DielectricMaterial>(spectra::GLASS_SF11_IOR()));
+    Material* dielectric = materials.back().get();
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            for (int k = 0; k < 4; k++) {
+                scene.add_sphere(Pt3(-1.5 + i, -1.5 + j, -6 + k), 0.45, dielectric);
+            }
+        }
+    }
+    scene.add_sphere(Pt3(-0.8f, -1.25f, -4.4f), 0.75f, dielectric);
+}
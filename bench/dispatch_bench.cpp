@@ -0,0 +1,85 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bench_scenes.hpp"
+#include "camera.hpp"
+#include "render.hpp"
+#include "scene.hpp"
+
+// just for command line options here
+#include <opencv2/opencv.hpp>
+
+// time rendering a scene with virtual and with closed-set material dispatch
+// both render the same samples, so their images should match
+void bench(
+    const std::string& name,
+    const std::function<void(Scene&, std::vector<std::unique_ptr<Material>>&)>& build,
+    const Camera& camera,
+    size_t n_samples,
+    size_t max_bounces,
+    int repeats
+) {
+    Scene scene(initialize_device());
+    std::vector<std::unique_ptr<Material>> materials;
+    build(scene, materials);
+    scene.commit();
+
+    std::cout << name << ":" << std::endl;
+    double times[2];
+    std::vector<float> images[2];
+    for (auto dispatch : { MaterialDispatch::VIRTUAL, MaterialDispatch::CLOSED }) {
+        scene.set_material_dispatch(dispatch);
+        size_t mode = dispatch == MaterialDispatch::CLOSED;
+        double best = std::numeric_limits<double>::infinity();
+        for (int i = 0; i < repeats; i++) {
+            auto start_time = std::chrono::steady_clock::now();
+            auto result = render(camera, scene, n_samples, max_bounces);
+            auto end_time = std::chrono::steady_clock::now();
+            best = std::min(best, std::chrono::duration<double>(end_time - start_time).count());
+            images[mode] = std::move(result.color_buffer);
+        }
+        times[mode] = best;
+        std::cout << "  " << (mode ? "closed " : "virtual") << " dispatch: " << best << " s" << std::endl;
+    }
+
+    float max_difference = 0.0f;
+    for (size_t i = 0; i < images[0].size(); i++) {
+        max_difference = std::max(max_difference, std::abs(images[0][i] - images[1][i]));
+    }
+    std::cout << "  speedup: " << times[0] / times[1] << "x, largest pixel difference: " << max_difference << std::endl;
+}
+
+int main(int argc, const char* const argv[]) {
+    cv::String keys =
+        "{help h usage ? | | Print this message.}"
+        "{s size         | 256 | Width and height of the image.}"
+        "{n samples      | 16 | Samples per pixel.}"
+        "{b bounces      | 64 | Maximum number of bounces.}"
+        "{r repeats      | 3 | Number of times to render each scene with each dispatch.}"
+        ;
+    cv::CommandLineParser parser(argc, argv, keys);
+    if (parser.has("help")) {
+        parser.printMessage();
+        return 0;
+    }
+    size_t size = parser.get<int>("s");
+    size_t n_samples = parser.get<int>("n");
+    size_t max_bounces = parser.get<int>("b");
+    int repeats = std::max(parser.get<int>("r"), 1);
+
+    Camera camera(size, size, M_PI / 3.0f);
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "Best of " << repeats << " renders of " << size << "x" << size << " pixels with "
+        << n_samples << " samples and " << max_bounces << " bounces" << std::endl;
+    bench("cornell_box", cornell_box, camera, n_samples, max_bounces, repeats);
+    bench("glass_spheres", glass_spheres, camera, n_samples, max_bounces, repeats);
+    return 0;
+}
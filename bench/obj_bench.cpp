@@ -0,0 +1,115 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include "mapped_file.hpp"
+#include "obj/obj.hpp"
+
+// just for command line options here
+#include <opencv2/opencv.hpp>
+
+// write a (grid_size x grid_size) quad mesh of a wavy surface, with normals, as a stand-in for a large scan
+void write_test_obj(const std::string& filename, size_t grid_size) {
+    std::ofstream file(filename);
+    file << "# generated by obj_bench" << std::endl;
+    for (size_t j = 0; j < grid_size; j++) {
+        for (size_t i = 0; i < grid_size; i++) {
+            float x = float(i) / grid_size;
+            float z = float(j) / grid_size;
+            file << "v " << x << " " << 0.05f * std::sin(20.0f * x) * std::cos(20.0f * z) << " " << z << "\n";
+        }
+    }
+    for (size_t j = 0; j < grid_size; j++) {
+        for (size_t i = 0; i < grid_size; i++) {
+            float x = float(i) / grid_size;
+            float z = float(j) / grid_size;
+            file << "vn " << -std::cos(20.0f * x) * std::cos(20.0f * z) << " 1 " << std::sin(20.0f * x) * std::sin(20.0f * z) << "\n";
+        }
+    }
+    for (size_t j = 0; j + 1 < grid_size; j++) {
+        for (size_t i = 0; i + 1 < grid_size; i++) {
+            size_t a = j * grid_size + i + 1;
+            size_t b = a + 1;
+            size_t c = a + grid_size + 1;
+            size_t d = a + grid_size;
+            file << "f " << a << "//" << a << " " << b << "//" << b << " " << c << "//" << c << " " << d << "//" << d << "\n";
+        }
+    }
+}
+
+int main(int argc, const char* const argv[]) {
+    cv::String keys =
+        "{help h usage ? | | Print this message.}"
+        "{@file          | | Input file. If not given, a large test mesh is generated.}"
+        "{g grid         | 1500 | Grid size of the generated test mesh.}"
+        "{r repeats      | 5 | Number of times to parse the file.}"
+        ;
+    cv::CommandLineParser parser(argc, argv, keys);
+    if (parser.has("help")) {
+        parser.printMessage();
+        return 0;
+    }
+    std::string filename = parser.get<cv::String>(0);
+    size_t grid_size = parser.get<int>("g");
+    int repeats = std::max(parser.get<int>("r"), 1);
+
+    if (filename.empty()) {
+        filename = (std::filesystem::temp_directory_path() / "obj_bench.obj").string();
+        std::cout << "Writing test mesh to " << filename << std::endl;
+        write_test_obj(filename, grid_size);
+    }
+    double size_mb = std::filesystem::file_size(filename) / (1024.0 * 1024.0);
+
+    // the first load also pulls the file into the page cache, so report it separately
+    auto start_time = std::chrono::steady_clock::now();
+    auto mesh = obj::load_obj(filename);
+    auto end_time = std::chrono::steady_clock::now();
+    if (!mesh) {
+        return 1;
+    }
+    double first = std::chrono::duration<double>(end_time - start_time).count();
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << mesh->n_vertices() << " vertices, " << mesh->n_faces(3) << " triangles, "
+        << mesh->n_faces(4) << " quads, " << size_mb << " MB" << std::endl;
+    std::cout << "First load: " << first << " s (" << size_mb / first << " MB/s)" << std::endl;
+    // the mesh's buffers are what the renderer keeps, so loading shouldn't need much more memory than them
+    double mesh_mb = (
+        mesh->vertices.size() * sizeof(float)
+        + (mesh->triangles.size() + mesh->quads.size()) * sizeof(unsigned int)
+        + mesh->normals.size() * sizeof(mesh->normals[0])
+        + (mesh->triangle_normals.size() + mesh->quad_normals.size()) * sizeof(int)
+    ) / (1024.0 * 1024.0);
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    std::cout << "Mesh buffers: " << mesh_mb << " MB, peak RSS: " << usage.ru_maxrss / 1024.0 << " MB" << std::endl;
+    mesh.reset();
+
+    // then time parsing alone, on one thread and on all of them, to show how well it scales
+    auto file = MappedFile::open(filename);
+    std::vector<size_t> thread_counts = { 1 };
+    if (std::thread::hardware_concurrency() > 1) {
+        thread_counts.push_back(std::thread::hardware_concurrency());
+    }
+    for (size_t n_threads : thread_counts) {
+        double best = std::numeric_limits<double>::infinity();
+        for (int i = 0; i < repeats; i++) {
+            start_time = std::chrono::steady_clock::now();
+            auto parsed = obj::parse_obj(file->view(), n_threads);
+            end_time = std::chrono::steady_clock::now();
+            best = std::min(best, std::chrono::duration<double>(end_time - start_time).count());
+        }
+        std::cout << "Best of " << repeats << " on " << n_threads << " threads: "
+            << best << " s (" << size_mb / best << " MB/s)" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,134 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "bench_scenes.hpp"
+#include "camera.hpp"
+#include "render.hpp"
+#include "scene.hpp"
+
+// just for command line options here
+#include <opencv2/opencv.hpp>
+
+// compare the noise of builds with different numbers of wavelengths per path (the QZ_SPECTRUM_SAMPLES option)
+// in the same render time
+// each build renders for the given time and reports its error against a converged reference; the reference
+// is saved the first time and then reused, so run each build with the same reference directory and compare their
+// errors, e.g. for builds configured with -DQZ_SPECTRUM_SAMPLES=4, 8 and 16 -DQZ_ARCH=native
+
+// reference images are saved as their width and height, then the color buffer
+std::optional<std::vector<float>> load_reference(const std::string& filename, size_t width, size_t height) {
+    std::ifstream file(filename, std::ios::binary);
+    uint64_t size[2];
+    if (!file.read(reinterpret_cast<char*>(size), sizeof(size)) || size[0] != width || size[1] != height) {
+        return std::nullopt;
+    }
+    std::vector<float> colors(3 * width * height);
+    if (!file.read(reinterpret_cast<char*>(colors.data()), colors.size() * sizeof(float))) {
+        return std::nullopt;
+    }
+    return colors;
+}
+
+void save_reference(const std::string& filename, size_t width, size_t height, const std::vector<float>& colors) {
+    std::ofstream file(filename, std::ios::binary);
+    uint64_t size[2] = { width, height };
+    file.write(reinterpret_cast<const char*>(size), sizeof(size));
+    file.write(reinterpret_cast<const char*>(colors.data()), colors.size() * sizeof(float));
+}
+
+// mean squared error relative to the reference, so that dark and bright pixels count alike
+double relative_mse(const std::vector<float>& colors, const std::vector<float>& reference) {
+    double sum = 0.0;
+    for (size_t i = 0; i < colors.size(); i++) {
+        double error = colors[i] - reference[i];
+        sum += error * error / (reference[i] * reference[i] + 1e-2);
+    }
+    return sum / colors.size();
+}
+
+void bench(
+    const std::string& name,
+    const std::function<void(Scene&, std::vector<std::unique_ptr<Material>>&)>& build,
+    const Camera& camera,
+    const std::string& reference_file,
+    size_t reference_samples,
+    double seconds,
+    size_t max_bounces
+) {
+    Scene scene(initialize_device());
+    std::vector<std::unique_ptr<Material>> materials;
+    build(scene, materials);
+    scene.commit();
+
+    auto render_timed = [&](size_t n_samples) {
+        auto start_time = std::chrono::steady_clock::now();
+        auto result = render(camera, scene, n_samples, max_bounces);
+        auto end_time = std::chrono::steady_clock::now();
+        return std::make_pair(std::move(result.color_buffer), std::chrono::duration<double>(end_time - start_time).count());
+    };
+
+    auto reference = load_reference(reference_file, camera.image_width, camera.image_height);
+    if (!reference) {
+        std::cout << "Rendering reference for " << name << " with " << reference_samples << " samples" << std::endl;
+        reference = render_timed(reference_samples).first;
+        save_reference(reference_file, camera.image_width, camera.image_height, *reference);
+    }
+
+    // find how many samples fit in the budget, from renders long enough that their fixed costs don't dominate
+    size_t calibration_samples = 1;
+    double calibration_time = render_timed(calibration_samples).second;
+    while (calibration_time < seconds / 8) {
+        calibration_samples *= 2;
+        calibration_time = render_timed(calibration_samples).second;
+    }
+    size_t n_samples = std::max<size_t>(1, seconds / calibration_time * calibration_samples);
+    auto [colors, time] = render_timed(n_samples);
+    double error = relative_mse(colors, *reference);
+    std::cout << name << ": " << n_samples << " samples in " << std::fixed << std::setprecision(3) << time
+        << " s, relative MSE " << std::scientific << error << ", relative MSE x time " << error * time << std::endl;
+}
+
+int main(int argc, const char* const argv[]) {
+    cv::String keys =
+        "{help h usage ? | | Print this message.}"
+        "{s size         | 128 | Width and height of the image.}"
+        "{t time         | 10 | Seconds to render each scene for.}"
+        "{b bounces      | 64 | Maximum number of bounces.}"
+        "{R reference    | 4096 | Samples per pixel for the reference images.}"
+        "{d directory    | | Directory to keep reference images in. Defaults to the temporary directory.}"
+        ;
+    cv::CommandLineParser parser(argc, argv, keys);
+    if (parser.has("help")) {
+        parser.printMessage();
+        return 0;
+    }
+    size_t size = parser.get<int>("s");
+    double seconds = parser.get<double>("t");
+    size_t max_bounces = parser.get<int>("b");
+    size_t reference_samples = parser.get<int>("R");
+    std::filesystem::path directory = parser.get<cv::String>("d");
+    if (directory.empty()) {
+        directory = std::filesystem::temp_directory_path();
+    }
+
+    Camera camera(size, size, M_PI / 3.0f);
+    std::cout << N_SPECTRUM_SAMPLES << " wavelengths per path, " << size << "x" << size << " pixels, "
+        << seconds << " s per scene" << std::endl;
+    auto reference_file = [&](const std::string& name) {
+        return (directory / ("spectral_bench_" + name + "_" + std::to_string(size) + ".bin")).string();
+    };
+    bench("cornell_box", cornell_box, camera, reference_file("cornell_box"), reference_samples, seconds, max_bounces);
+    bench("glass_spheres", glass_spheres, camera, reference_file("glass_spheres"), reference_samples, seconds, max_bounces);
+    return 0;
+}
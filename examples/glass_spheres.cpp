@@ -45,16 +45,20 @@ int main() {
     Camera camera(
         800, 800, M_PI / 3.0f
     );
-    size_t n_samples = 512;
+    // caustics through the spheres need far more samples than the empty background
+    AdaptiveSampling sampling {
+        .min_samples = 64,
+        .max_samples = 512
+    };
     size_t max_bounces = 64;
 
     std::cout << "Rendering " << camera.image_height * camera.image_width << " pixels with " <<
-        n_samples << " samples and " << max_bounces << " bounces" << std::endl;
+        sampling.min_samples << "-" << sampling.max_samples << " samples and " << max_bounces << " bounces" << std::endl;
 
     auto result = render(
         camera,
         scene,
-        n_samples, max_bounces
+        sampling, max_bounces
     );
     result.save("glass_spheres_no_denoise.png");
 
@@ -0,0 +1,64 @@
+#include <cmath>
+#include <iostream>
+#include <string>
+
+#include "image.hpp"
+#include "texture_cache.hpp"
+
+// just for command line options and reading images here
+#include <opencv2/opencv.hpp>
+
+// convert an image file to a tiled texture file, which a TextureCache can read a tile at a time
+int main(int argc, const char* const argv[]) {
+    cv::String keys =
+        "{help h usage ? | | Print this message.}"
+        "{@input         | | Input image file.}"
+        "{@output        | | Output texture file. Defaults to the input file with its extension replaced.}"
+        "{g gamma        | 2.2 | Gamma the image is encoded with.}"
+        "{t tile         | 32 | Width and height of the tiles, in texels.}"
+        ;
+    cv::CommandLineParser parser(argc, argv, keys);
+    if (parser.has("help")) {
+        parser.printMessage();
+        return 0;
+    }
+    std::string input = parser.get<cv::String>(0);
+    std::string output = parser.get<cv::String>(1);
+    float gamma = parser.get<float>("g");
+    int tile_size = parser.get<int>("t");
+    if (!parser.check() || input.empty() || tile_size <= 0) {
+        parser.printErrors();
+        parser.printMessage();
+        return 1;
+    }
+    if (output.empty()) {
+        output = input.substr(0, input.rfind('.')) + ".qztex";
+    }
+
+    cv::Mat mat = cv::imread(input, cv::IMREAD_COLOR);
+    if (mat.empty()) {
+        std::cerr << "Failed to read " << input << std::endl;
+        return 1;
+    }
+    mat.convertTo(mat, CV_32FC3, 1.0 / 255.0);
+    Image image(mat.rows, mat.cols);
+    for (int y = 0; y < mat.rows; y++) {
+        for (int x = 0; x < mat.cols; x++) {
+            // opencv stores B, G, R
+            const cv::Vec3f& bgr = mat.at<cv::Vec3f>(y, x);
+            size_t index = y * image.width + x;
+            for (size_t c = 0; c < 3; c++) {
+                image.color_buffer[3 * index + c] = std::pow(bgr[2 - c], gamma);
+            }
+        }
+    }
+    size_t width = image.width;
+    size_t height = image.height;
+    if (!write_texture_file(output, std::move(image), *RGBColorSpace::sRGB(), tile_size)) {
+        std::cerr << "Failed to write " << output << std::endl;
+        return 1;
+    }
+    std::cout << "Wrote " << width << "x" << height << " texels in " << tile_size << "x" << tile_size
+        << " tiles to " << output << std::endl;
+    return 0;
+}
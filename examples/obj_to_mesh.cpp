@@ -0,0 +1,44 @@
+#include <iostream>
+#include <string>
+
+#include "mesh_file.hpp"
+#include "obj/obj.hpp"
+
+// just for command line options here
+#include <opencv2/opencv.hpp>
+
+// convert a .obj file to a binary .mesh file, which Scene::add_mesh_file can load without parsing
+int main(int argc, const char* const argv[]) {
+    cv::String keys =
+        "{help h usage ? | | Print this message.}"
+        "{@input         | | Input .obj file.}"
+        "{@output        | | Output .mesh file. Defaults to the input file with its extension replaced.}"
+        ;
+    cv::CommandLineParser parser(argc, argv, keys);
+    if (parser.has("help")) {
+        parser.printMessage();
+        return 0;
+    }
+    std::string input = parser.get<cv::String>(0);
+    std::string output = parser.get<cv::String>(1);
+    if (!parser.check() || input.empty()) {
+        parser.printErrors();
+        parser.printMessage();
+        return 1;
+    }
+    if (output.empty()) {
+        output = input.substr(0, input.rfind('.')) + ".mesh";
+    }
+
+    auto mesh = obj::load_obj(input);
+    if (!mesh) {
+        return 1;
+    }
+    if (!write_mesh_file(output, *mesh)) {
+        std::cerr << "Failed to write " << output << std::endl;
+        return 1;
+    }
+    std::cout << "Wrote " << mesh->n_vertices() << " vertices, " << mesh->normals.size() << " normals, "
+        << mesh->n_faces(3) << " triangles and " << mesh->n_faces(4) << " quads to " << output << std::endl;
+    return 0;
+}
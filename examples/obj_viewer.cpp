@@ -9,7 +9,7 @@
 int main(int argc, const char* const argv[]) {
     cv::String keys =
         "{help h usage ? | | Print this message.}"
-        "{@file           | test.obj | Input file.}"
+        "{@file           | test.obj | Input file, either .obj or a binary .mesh made by obj_to_mesh.}"
         "{x x_offset     | 0. | X offset.}"
         "{y y_offset     | 0. | Y offset.}"
         "{z z_offset     | 0. | Z offset.}"
@@ -24,6 +24,9 @@ int main(int argc, const char* const argv[]) {
         "{b bounces | 32 | maximum number of ray bounces per pixel sample}"
         "{nobg | | Do not render background.}"
         "{l light | point | Light type, one of point, ambient, area}"
+        "{w wavefront | | Use the wavefront integrator.}"
+        "{rgb | | Render in RGB rather than spectrally, which is faster but less accurate.}"
+        "{c cache | | Directory to cache processed .obj meshes in, to skip parsing them on later renders.}"
         ;
     cv::CommandLineParser parser(argc, argv, keys);
     if (parser.has("help")) {
@@ -47,6 +50,8 @@ int main(int argc, const char* const argv[]) {
     std::string material_type = parser.get<std::string>("m");
     bool render_background = !parser.has("nobg");
     std::string light_type = parser.get<std::string>("light");
+    bool wavefront = parser.has("wavefront");
+    bool rgb = parser.has("rgb");
     
     std::unique_ptr<Material> material;
     if (material_type == "diffuse") {
@@ -72,6 +77,9 @@ int main(int argc, const char* const argv[]) {
     }
 
     Scene scene(initialize_device());
+    if (parser.has("cache")) {
+        scene.set_cache_dir(parser.get<std::string>("cache"));
+    }
 
     // auto light_spectrum = std::make_shared<RGBIlluminantSpectrum>(RGB(3.0, 1.0, 2.0));
     auto light_spectrum = spectra::ILLUM_D65();
@@ -109,7 +117,12 @@ int main(int argc, const char* const argv[]) {
         * Transform::rotate_y(rotation.y)
         * Transform::rotate_z(rotation.z)
         * Transform::scale(scale);
-    scene.add_obj(filename, material.get(), transform);
+    if (filename.ends_with(".mesh")) {
+        scene.add_mesh_file(filename, material.get(), transform);
+    }
+    else {
+        scene.add_obj(filename, material.get(), transform);
+    }
 
     DiffuseMaterial floor(SolidColor(1.0, 0.1, 0.9));
     if (render_background) {
@@ -126,6 +139,9 @@ int main(int argc, const char* const argv[]) {
     }
 
     scene.commit();
+    if (rgb) {
+        scene.set_color_mode(ColorMode::RGB);
+    }
 
     Camera camera(
         width, height, M_PI / 3.0,
@@ -133,10 +149,12 @@ int main(int argc, const char* const argv[]) {
         * Transform::rotate_x(-M_PI / 8.0)
     );
 
-    auto result = render(camera, scene, n_samples, max_bounces);
+    auto result = wavefront
+        ? render_wavefront(camera, scene, n_samples, max_bounces)
+        : render(camera, scene, n_samples, max_bounces);
 
-    // get filename base by removing .obj
-    std::string filename_base = filename.substr(0, filename.length() - 4);
+    // get filename base by removing the extension
+    std::string filename_base = filename.substr(0, filename.rfind('.'));
 
     result.save_albedo(filename_base + "_albedo.png");
     result.save_normal(filename_base + "_normal.png");
@@ -0,0 +1,26 @@
+#include <algorithm>
+#include <cstdint>
+
+#include "arena.hpp"
+
+void* Arena::allocate(size_t size, size_t alignment) {
+    while (true) {
+        if (m_block < m_blocks.size()) {
+            Block& block = m_blocks[m_block];
+            uintptr_t start = reinterpret_cast<uintptr_t>(block.data.get());
+            // align the address rather than the offset, since blocks are only aligned for fundamental types
+            size_t offset = (start + m_offset + alignment - 1) / alignment * alignment - start;
+            if (offset + size <= block.size) {
+                m_offset = offset + size;
+                return block.data.get() + offset;
+            }
+            // the rest of this block is wasted until the next reset
+            m_block++;
+            m_offset = 0;
+            continue;
+        }
+        // out of blocks, so add one big enough for this allocation
+        size_t block_size = std::max(m_block_size, size + alignment);
+        m_blocks.push_back({ std::make_unique<std::byte[]>(block_size), block_size });
+    }
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+// a bump allocator for objects that only live for a short while, like the BxDF made at each path vertex
+// allocating just moves an offset along a block, and reset frees everything at once
+// reset keeps the blocks, so once an arena has grown to fit a thread's working set it never touches the heap again
+// destructors aren't run, so objects made here mustn't own anything
+// an arena isn't thread safe; each thread should have its own
+class Arena {
+public:
+    explicit Arena(size_t block_size = 16 * 1024) : m_block_size(block_size) {}
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    // construct a T in the arena
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    void* allocate(size_t size, size_t alignment);
+
+    // free everything allocated so far
+    void reset() {
+        m_block = 0;
+        m_offset = 0;
+    }
+
+private:
+    struct Block {
+        std::unique_ptr<std::byte[]> data;
+        size_t size;
+    };
+
+    size_t m_block_size;
+    std::vector<Block> m_blocks;
+    // the block currently being allocated from, and how much of it is used
+    size_t m_block = 0;
+    size_t m_offset = 0;
+};
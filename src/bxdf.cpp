@@ -79,7 +79,7 @@ SpectrumSample BSDF::operator()(Vec3 wo_render, Vec3 wi_render) const {
     if (wo.z == 0.0f) {
         return SpectrumSample(0.0f);
     }
-    return (*m_bxdf)(wo, wi);
+    return visit([&](const auto& bxdf) { return bxdf(wo, wi); });
 }
 
 std::optional<BSDFSample> BSDF::sample(Vec3 wo_render, float sample1, Vec2 sample2) const {
@@ -87,7 +87,7 @@ std::optional<BSDFSample> BSDF::sample(Vec3 wo_render, float sample1, Vec2 sampl
     if (wo.z == 0.0f) {
         return std::nullopt;
     }
-    auto bs = (*m_bxdf).sample(wo, sample1, sample2);
+    auto bs = visit([&](const auto& bxdf) { return bxdf.sample(wo, sample1, sample2); });
     if (!bs || bs->spec.is_zero() || bs->pdf == 0.0f || bs->wi.z == 0.0f) {
         return std::nullopt;
     }
@@ -101,15 +101,15 @@ float BSDF::pdf(Vec3 wo_render, Vec3 wi_render) const {
     if (wo.z == 0.0f) {
         return 0.0f;
     }
-    return m_bxdf->pdf(wo, wi);
+    return visit([&](const auto& bxdf) { return bxdf.pdf(wo, wi); });
 }
 
 SpectrumSample BSDF::rho_hd(Vec3 wo_render, Sampler& sampler, size_t n_samples) const {
-    return m_bxdf->rho_hd(local_from_render(wo_render), sampler, n_samples);
+    return visit([&](const auto& bxdf) { return bxdf.rho_hd(local_from_render(wo_render), sampler, n_samples); });
 }
 
 SpectrumSample BSDF::rho_hh(Sampler& sampler, size_t n_samples) const {
-    return m_bxdf->rho_hh(sampler, n_samples);
+    return visit([&](const auto& bxdf) { return bxdf.rho_hh(sampler, n_samples); });
 }
 
 
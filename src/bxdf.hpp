@@ -1,6 +1,8 @@
 #pragma once
 
 #include <optional>
+#include <type_traits>
+#include <variant>
 
 #include "color/color.hpp"
 #include "onb.hpp"
@@ -76,43 +78,7 @@ public:
     virtual bool is_specular() const { return false; }
 };
 
-// A wrapper around a BxDF that converts from world to local coordinates
-class BSDF {
-public:
-    BSDF(Vec3 shading_normal, std::unique_ptr<BxDF>&& bxdf) : m_basis(shading_normal), m_bxdf(std::move(bxdf)) {}
-
-    Vec3 local_from_render(Vec3 v) const { return m_basis.to_local(v); }
-    
-    Vec3 render_from_local(Vec3 v) const { return m_basis.from_local(v); }
-
-    SpectrumSample operator()(Vec3 wo_render, Vec3 wi_render) const;
-
-    std::optional<BSDFSample> sample(Vec3 wo_render, float sample1, Vec2 sample2) const;
-
-    float pdf(Vec3 wo_render, Vec3 wi_render) const;
-
-    SpectrumSample rho_hd(Vec3 wo_render, Sampler& sampler, size_t n_samples) const;
-    
-    template <size_t N>
-    SpectrumSample rho_hd(Vec3 wo_render, const std::array<float, N>& uc, const std::array<Vec2, N>& u2) const {
-        return m_bxdf->rho_hd(local_from_render(wo_render), uc, u2);
-    }
-
-    SpectrumSample rho_hh(Sampler& sampler, size_t n_samples) const;
-
-    template <size_t N>
-    SpectrumSample rho_hh(const std::array<Vec2, N>& u1, const std::array<float, N>& uc, const std::array<Vec2, N>& u2) const {
-        return m_bxdf->rho_hh(u1, uc, u2);
-    }
-
-    bool is_specular() const { return m_bxdf->is_specular(); }
-
-    OrthonormalBasis m_basis;
-    std::unique_ptr<BxDF> m_bxdf;
-};
-
-
-class DiffuseBxDF : public BxDF {
+class DiffuseBxDF final : public BxDF {
 public:
     explicit DiffuseBxDF(float r) : m_reflectance(r) {}
     explicit DiffuseBxDF(const SpectrumSample& reflectance) : m_reflectance(reflectance) {}
@@ -147,7 +113,7 @@ private:
     float lambda(Vec3 w) const;
 };
 
-class ConductorBxDF : public BxDF {
+class ConductorBxDF final : public BxDF {
 public:
     ConductorBxDF(float ior, float absorption, float roughness = 0.0f) : m_ior(ior), m_absorption(absorption), m_roughness(roughness, roughness) {}
     ConductorBxDF(
@@ -169,7 +135,7 @@ private:
 };
 
 
-class DielectricBxDF : public BxDF {
+class DielectricBxDF final : public BxDF {
 public:
     explicit DielectricBxDF(float ior) : m_ior(ior) {}
 
@@ -184,7 +150,7 @@ private:
 };
 
 
-class ThinDielectricBxDF : public BxDF {
+class ThinDielectricBxDF final : public BxDF {
 public:
     explicit ThinDielectricBxDF(float ior) : m_ior(ior) {}
 
@@ -197,3 +163,60 @@ public:
 private:
     float m_ior;
 };
+
+
+// A wrapper around a BxDF that converts from world to local coordinates
+// the built-in BxDFs can be held by value, in which case calls on them are resolved at compile time;
+// any other BxDF is held by pointer and called through its vtable, and isn't owned (materials make it in
+// an Arena, which has to outlive the BSDF)
+class BSDF {
+public:
+    BSDF(Vec3 shading_normal, const BxDF* bxdf) : m_basis(shading_normal), m_bxdf(bxdf) {}
+
+    template <typename T> requires (!std::is_pointer_v<std::remove_cvref_t<T>>)
+    BSDF(Vec3 shading_normal, T&& bxdf) : m_basis(shading_normal), m_bxdf(std::forward<T>(bxdf)) {}
+
+    // call f with the BxDF, as its own type if it's held by value, or as a BxDF otherwise
+    template <typename F>
+    decltype(auto) visit(F&& f) const {
+        return std::visit([&](const auto& bxdf) -> decltype(auto) {
+            if constexpr (std::is_pointer_v<std::remove_cvref_t<decltype(bxdf)>>) {
+                return f(*bxdf);
+            }
+            else {
+                return f(bxdf);
+            }
+        }, m_bxdf);
+    }
+
+    Vec3 local_from_render(Vec3 v) const { return m_basis.to_local(v); }
+    
+    Vec3 render_from_local(Vec3 v) const { return m_basis.from_local(v); }
+
+    SpectrumSample operator()(Vec3 wo_render, Vec3 wi_render) const;
+
+    std::optional<BSDFSample> sample(Vec3 wo_render, float sample1, Vec2 sample2) const;
+
+    float pdf(Vec3 wo_render, Vec3 wi_render) const;
+
+    SpectrumSample rho_hd(Vec3 wo_render, Sampler& sampler, size_t n_samples) const;
+    
+    template <size_t N>
+    SpectrumSample rho_hd(Vec3 wo_render, const std::array<float, N>& uc, const std::array<Vec2, N>& u2) const {
+        return visit([&](const auto& bxdf) { return bxdf.rho_hd(local_from_render(wo_render), uc, u2); });
+    }
+
+    SpectrumSample rho_hh(Sampler& sampler, size_t n_samples) const;
+
+    template <size_t N>
+    SpectrumSample rho_hh(const std::array<Vec2, N>& u1, const std::array<float, N>& uc, const std::array<Vec2, N>& u2) const {
+        return visit([&](const auto& bxdf) { return bxdf.rho_hh(u1, uc, u2); });
+    }
+
+    bool is_specular() const {
+        return visit([](const auto& bxdf) { return bxdf.is_specular(); });
+    }
+
+    OrthonormalBasis m_basis;
+    std::variant<const BxDF*, DiffuseBxDF, ConductorBxDF, DielectricBxDF, ThinDielectricBxDF> m_bxdf;
+};
@@ -29,4 +29,11 @@ Ray Camera::cast_ray(float u, float v) const {
         pos,
         viewport_bottom_left + pixel_delta_u * u + pixel_delta_v * v - pos
     );
-}
\ No newline at end of file
+}
+
+RayDifferentials Camera::differentials(const Ray& ray) const {
+    return RayDifferentials {
+        .rx = Ray(pos, ray.d + pixel_delta_u),
+        .ry = Ray(pos, ray.d + pixel_delta_v)
+    };
+}
@@ -20,6 +20,9 @@ public:
 
     // creates a ray pointing to the pixel coordinates (u, v)
     Ray cast_ray(float u, float v) const;
+    // the differentials of a ray made by cast_ray
+    // every camera ray starts at pos, so they follow from the ray's direction alone
+    RayDifferentials differentials(const Ray& ray) const;
 
     size_t image_height;
     size_t image_width;
@@ -47,6 +47,33 @@ RGB RGBColorSpace::rgb_from_sample(const SpectrumSample& ss, const WavelengthSam
     return rgb_from_xyz(XYZ::from_sample(ss, wl));
 }
 
+RGB RGBColorSpace::illuminant_rgb(const Spectrum& spectrum) const {
+    return rgb_from_xyz(XYZ::from_spectrum(spectrum));
+}
+
+namespace {
+
+// a reflectance lit by an illuminant
+class ReflectedSpectrum : public Spectrum {
+public:
+    ReflectedSpectrum(const Spectrum& reflectance, const Spectrum& illuminant) : m_reflectance(reflectance), m_illuminant(illuminant) {}
+
+    float operator()(float lambda) const override {
+        return m_reflectance(lambda) * m_illuminant(lambda);
+    }
+
+private:
+    const Spectrum& m_reflectance;
+    const Spectrum& m_illuminant;
+};
+
+} // namespace
+
+RGB RGBColorSpace::reflectance_rgb(const Spectrum& spectrum) const {
+    // the illuminant itself is white, so a perfect reflector comes out as (1, 1, 1)
+    return illuminant_rgb(ReflectedSpectrum(spectrum, *m_illuminant));
+}
+
 RGBSigmoidPolynomial RGBColorSpace::to_spectrum(const RGB& rgb) const {
     return m_table->operator()(RGB(
         std::clamp(rgb.x, 0.0f, 1.0f),
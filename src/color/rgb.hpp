@@ -54,6 +54,11 @@ public:
 
     RGB rgb_from_sample(const SpectrumSample& ss, const WavelengthSample& wl) const;
 
+    // linear RGB of light with the given spectrum
+    RGB illuminant_rgb(const Spectrum& spectrum) const;
+    // linear RGB of a surface with the given reflectance, lit by the color space's illuminant
+    RGB reflectance_rgb(const Spectrum& spectrum) const;
+
     RGBSigmoidPolynomial to_spectrum(const RGB& rgb) const;
 
     Vec2 whitepoint() const {
@@ -1,4 +1,6 @@
 #include <algorithm>
+#include <array>
+#include <cassert>
 
 #include "sensor.hpp"
 
@@ -30,6 +32,41 @@ Mat3 white_balance(Vec2 source_white, Vec2 target_white) {
     return LMS_FROM_XYZ * lms_correct * LMS_FROM_XYZ;
 }
 
+// maps linear RGB in cs to the response of a sensor with the given curves, for RGB renders
+// each curve is fit (by least squares) as a combination of the CIE matching functions, so that the response to
+// a color follows from its XYZ, then scaled so that white gets the same response as the color space's illuminant
+Mat3 sensor_from_rgb(const Spectrum& r, const Spectrum& g, const Spectrum& b, const RGBColorSpace& cs, float imaging_ratio) {
+    std::array<const Spectrum*, 3> curves = { &r, &g, &b };
+    std::array<const Spectrum*, 3> cie = { spectra::X().get(), spectra::Y().get(), spectra::Z().get() };
+    Mat3 gram;
+    Mat3 projections;
+    for (size_t i = 0; i < 3; i++) {
+        for (size_t j = 0; j < 3; j++) {
+            gram[3 * i + j] = cie[i]->inner_product(*cie[j]);
+            projections[3 * i + j] = curves[i]->inner_product(*cie[j]);
+        }
+    }
+    auto gram_inv = gram.invert();
+    assert(gram_inv.has_value());
+    Mat3 sensor_from_xyz = projections * gram_inv.value();
+
+    Mat3 xyz_from_rgb;
+    for (size_t j = 0; j < 3; j++) {
+        RGB primary(j == 0, j == 1, j == 2);
+        XYZ xyz = cs.rgb_to_xyz(primary);
+        xyz_from_rgb[j] = xyz.x;
+        xyz_from_rgb[3 + j] = xyz.y;
+        xyz_from_rgb[6 + j] = xyz.z;
+    }
+    Mat3 fit = sensor_from_xyz * xyz_from_rgb;
+    std::array<float, 3> fit_white = fit * std::array<float, 3>{ 1.0f, 1.0f, 1.0f };
+    std::array<float, 3> scale;
+    for (size_t i = 0; i < 3; i++) {
+        scale[i] = imaging_ratio * curves[i]->inner_product(*cs.m_illuminant) / fit_white[i];
+    }
+    return Mat3::diagonal(scale) * fit;
+}
+
 PixelSensor::PixelSensor(
     const RGBColorSpace& cs,
     const Spectrum& illuminant,
@@ -38,6 +75,7 @@ PixelSensor::PixelSensor(
     auto source_white = XYZ::from_spectrum(illuminant).xy();
     auto target_white = cs.whitepoint();
     m_xyz_from_sensor_rgb = white_balance(source_white, target_white);
+    m_sensor_from_rgb = sensor_from_rgb(m_r, m_g, m_b, cs, imaging_ratio);
 }
 
 PixelSensor::PixelSensor(
@@ -52,15 +90,22 @@ PixelSensor::PixelSensor(
     auto source_white = XYZ::from_spectrum(illuminant).xy();
     auto target_white = cs.whitepoint();
     m_xyz_from_sensor_rgb = white_balance(source_white, target_white);
+    m_sensor_from_rgb = sensor_from_rgb(m_r, m_g, m_b, cs, imaging_ratio);
 }
 
 RGB PixelSensor::to_sensor_rgb(const SpectrumSample& sample, const WavelengthSample& wavelengths) const {
-    auto l = sample / SpectrumSample::from_wavelengths_pdf(wavelengths);
-    RGB rgb(
-        (SpectrumSample::from_spectrum(m_r, wavelengths) * l).average() * m_imaging_ratio,
-        (SpectrumSample::from_spectrum(m_g, wavelengths) * l).average() * m_imaging_ratio,
-        (SpectrumSample::from_spectrum(m_b, wavelengths) * l).average() * m_imaging_ratio
-    );
+    RGB rgb;
+    if (wavelengths.is_rgb()) {
+        rgb = RGB(m_sensor_from_rgb * Vec3(sample[0], sample[1], sample[2]));
+    }
+    else {
+        auto l = sample / SpectrumSample::from_wavelengths_pdf(wavelengths);
+        rgb = RGB(
+            (SpectrumSample::from_spectrum(m_r, wavelengths) * l).average() * m_imaging_ratio,
+            (SpectrumSample::from_spectrum(m_g, wavelengths) * l).average() * m_imaging_ratio,
+            (SpectrumSample::from_spectrum(m_b, wavelengths) * l).average() * m_imaging_ratio
+        );
+    }
     // clamp total contribution to avoid super bright speckles
     float m = std::max({rgb.x, rgb.y, rgb.z});
     if (m > SENSOR_SATURATION) {
@@ -22,6 +22,7 @@ public:
         float imaging_ratio = 1.0f
     );
 
+    // convert a path's sample, which may be spectral or RGB (see ColorMode)
     RGB to_sensor_rgb(const SpectrumSample& sample, const WavelengthSample& wavelengths) const;
 
     static PixelSensor CIE_XYZ(float imaging_ratio = 1.0f / spectra::CIE_Y_INTEGRAL);
@@ -33,4 +34,6 @@ private:
     DenselySampledSpectrum m_b;
     float m_imaging_ratio;
     Mat3 m_xyz_from_sensor_rgb;
+    // for samples from RGB renders, which hold linear RGB in the sensor's color space
+    Mat3 m_sensor_from_rgb;
 };
@@ -53,6 +53,20 @@ float DenselySampledSpectrum::operator()(float lambda) const {
 }
 
 
+void SpectrumBaker::bake(std::shared_ptr<const Spectrum>& spectrum) {
+    if (!spectrum
+        || dynamic_cast<const ConstantSpectrum*>(spectrum.get())
+        || dynamic_cast<const DenselySampledSpectrum*>(spectrum.get())) {
+        return;
+    }
+    auto [it, inserted] = m_baked.try_emplace(spectrum.get());
+    if (inserted) {
+        it->second = { spectrum, std::make_shared<DenselySampledSpectrum>(*spectrum) };
+    }
+    spectrum = it->second.second;
+}
+
+
 PiecewiseLinearSpectrum::PiecewiseLinearSpectrum(
     std::vector<float>&& lambdas,
     std::vector<float>&& values
@@ -85,7 +99,7 @@ PiecewiseLinearSpectrum PiecewiseLinearSpectrum::from_interleaved(
         lambdas.push_back(interleaved[i]);
         values.push_back(interleaved[i + 1]);
     }
-    if (interleaved.back() < LAMBDA_MAX) {
+    if (interleaved[interleaved.size() - 2] < LAMBDA_MAX) {
         lambdas.push_back(LAMBDA_MAX + 1);
         values.push_back(interleaved.back());
     }
@@ -102,10 +116,14 @@ float PiecewiseLinearSpectrum::operator()(float lambda) const {
     if (m_lambdas.empty() || lambda < m_lambdas.front() || lambda > m_lambdas.back()) {
         return 0.0f;
     }
-    auto pp = std::lower_bound(m_lambdas.begin(), m_lambdas.end(), lambda);
+    // lambda is between m_lambdas[i - 1] and m_lambdas[i]
+    auto pp = std::upper_bound(m_lambdas.begin(), m_lambdas.end(), lambda);
     size_t i = std::distance(m_lambdas.begin(), pp);
-    float t = (lambda - m_lambdas[i]) / (m_lambdas[i + 1] - m_lambdas[i]);
-    return m_values[i] * (1.0f - t) + m_values[i + 1] * t;
+    if (i == m_lambdas.size()) {
+        return m_values.back();
+    }
+    float t = (lambda - m_lambdas[i - 1]) / (m_lambdas[i] - m_lambdas[i - 1]);
+    return m_values[i - 1] * (1.0f - t) + m_values[i] * t;
 }
 
 
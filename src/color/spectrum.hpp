@@ -1,6 +1,7 @@
 #pragma once
 
 #include <memory>
+#include <unordered_map>
 #include <vector>
 
 
@@ -81,6 +82,19 @@ private:
 };
 
 
+// replaces spectra with DenselySampledSpectrum tables at 1 nm, which take a single lookup to evaluate
+// each spectrum is baked once, however many times (or by however many owners) it's passed in
+class SpectrumBaker {
+public:
+    // spectra that are already constant or densely sampled (and null ones) are left as they are
+    void bake(std::shared_ptr<const Spectrum>& spectrum);
+
+private:
+    // keyed by the original spectrum, which is kept alive along with its table so that its address isn't reused
+    std::unordered_map<const Spectrum*, std::pair<std::shared_ptr<const Spectrum>, std::shared_ptr<const Spectrum>>> m_baked;
+};
+
+
 class BlackbodySpectrum : public Spectrum {
 public:
     explicit BlackbodySpectrum(float t);
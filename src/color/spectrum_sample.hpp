@@ -3,10 +3,161 @@
 #include <array>
 #include <cstddef>
 #include <memory>
+#include <type_traits>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
 
 #include "spectrum.hpp"
 
-const size_t N_SPECTRUM_SAMPLES = 4;
+// number of wavelengths traced along each path, set with the QZ_SPECTRUM_SAMPLES CMake option
+// more wavelengths give less color noise per path, and cost little more while they fit in one SIMD register
+#ifndef QZ_SPECTRUM_SAMPLES
+#define QZ_SPECTRUM_SAMPLES 4
+#endif
+constexpr size_t N_SPECTRUM_SAMPLES = QZ_SPECTRUM_SAMPLES;
+static_assert(N_SPECTRUM_SAMPLES > 0, "QZ_SPECTRUM_SAMPLES must be positive");
+
+// these types are used in every step of a path, so their arithmetic is defined here to be inlined
+// element-wise operations work on whole SIMD registers: the widest of SSE (4 floats), AVX (8) and AVX-512 (16)
+// that's enabled (e.g. with -mavx2 or -march=native) and evenly divides N_SPECTRUM_SAMPLES, falling back to a
+// plain loop otherwise
+// each lane does exactly what the scalar loop would, so results don't depend on which of these is used
+// reductions (is_zero aside) stay scalar, since summing or comparing in a different order could change them
+namespace spectrum_simd {
+
+struct ScalarLanes {
+    static constexpr size_t width = 1;
+    using Reg = float;
+    static Reg load(const float* p) { return *p; }
+    static void store(float* p, Reg v) { *p = v; }
+    static Reg broadcast(float c) { return c; }
+    static Reg add(Reg a, Reg b) { return a + b; }
+    static Reg sub(Reg a, Reg b) { return a - b; }
+    static Reg mul(Reg a, Reg b) { return a * b; }
+    // a / b, or 0 where b is 0
+    static Reg safe_div(Reg a, Reg b) { return b == 0.0f ? 0.0f : a / b; }
+    static bool any_nonzero(Reg v) { return v != 0.0f; }
+};
+
+#if defined(__SSE__) || defined(_M_X64)
+struct SSELanes {
+    static constexpr size_t width = 4;
+    using Reg = __m128;
+    static Reg load(const float* p) { return _mm_load_ps(p); }
+    static void store(float* p, Reg v) { _mm_store_ps(p, v); }
+    static Reg broadcast(float c) { return _mm_set1_ps(c); }
+    static Reg add(Reg a, Reg b) { return _mm_add_ps(a, b); }
+    static Reg sub(Reg a, Reg b) { return _mm_sub_ps(a, b); }
+    static Reg mul(Reg a, Reg b) { return _mm_mul_ps(a, b); }
+    static Reg safe_div(Reg a, Reg b) {
+        return _mm_andnot_ps(_mm_cmpeq_ps(b, _mm_setzero_ps()), _mm_div_ps(a, b));
+    }
+    // cmpneq is true for NaN, like != is
+    static bool any_nonzero(Reg v) { return _mm_movemask_ps(_mm_cmpneq_ps(v, _mm_setzero_ps())) != 0; }
+};
+#endif
+
+#if defined(__AVX__)
+struct AVXLanes {
+    static constexpr size_t width = 8;
+    using Reg = __m256;
+    static Reg load(const float* p) { return _mm256_load_ps(p); }
+    static void store(float* p, Reg v) { _mm256_store_ps(p, v); }
+    static Reg broadcast(float c) { return _mm256_set1_ps(c); }
+    static Reg add(Reg a, Reg b) { return _mm256_add_ps(a, b); }
+    static Reg sub(Reg a, Reg b) { return _mm256_sub_ps(a, b); }
+    static Reg mul(Reg a, Reg b) { return _mm256_mul_ps(a, b); }
+    static Reg safe_div(Reg a, Reg b) {
+        return _mm256_andnot_ps(_mm256_cmp_ps(b, _mm256_setzero_ps(), _CMP_EQ_OQ), _mm256_div_ps(a, b));
+    }
+    static bool any_nonzero(Reg v) {
+        return _mm256_movemask_ps(_mm256_cmp_ps(v, _mm256_setzero_ps(), _CMP_NEQ_UQ)) != 0;
+    }
+};
+#endif
+
+#if defined(__AVX512F__)
+struct AVX512Lanes {
+    static constexpr size_t width = 16;
+    using Reg = __m512;
+    static Reg load(const float* p) { return _mm512_load_ps(p); }
+    static void store(float* p, Reg v) { _mm512_store_ps(p, v); }
+    static Reg broadcast(float c) { return _mm512_set1_ps(c); }
+    static Reg add(Reg a, Reg b) { return _mm512_add_ps(a, b); }
+    static Reg sub(Reg a, Reg b) { return _mm512_sub_ps(a, b); }
+    static Reg mul(Reg a, Reg b) { return _mm512_mul_ps(a, b); }
+    static Reg safe_div(Reg a, Reg b) {
+        return _mm512_maskz_div_ps(_mm512_cmp_ps_mask(b, _mm512_setzero_ps(), _CMP_NEQ_UQ), a, b);
+    }
+    static bool any_nonzero(Reg v) {
+        return _mm512_cmp_ps_mask(v, _mm512_setzero_ps(), _CMP_NEQ_UQ) != 0;
+    }
+};
+#endif
+
+// the widest lanes that evenly divide n floats
+template <size_t n>
+using LanesFor =
+#if defined(__AVX512F__)
+    std::conditional_t<n % 16 == 0, AVX512Lanes,
+#endif
+#if defined(__AVX__)
+    std::conditional_t<n % 8 == 0, AVXLanes,
+#endif
+#if defined(__SSE__) || defined(_M_X64)
+    std::conditional_t<n % 4 == 0, SSELanes,
+#endif
+    ScalarLanes
+#if defined(__SSE__) || defined(_M_X64)
+    >
+#endif
+#if defined(__AVX__)
+    >
+#endif
+#if defined(__AVX512F__)
+    >
+#endif
+    ;
+
+using Lanes = LanesFor<N_SPECTRUM_SAMPLES>;
+
+// sample arrays are aligned to this so that whole registers can be loaded and stored
+constexpr size_t ALIGNMENT = Lanes::width * sizeof(float);
+
+// out[i] = op(a[i], b[i]) over whole registers
+template <auto op>
+void apply(float* out, const float* a, const float* b) {
+    for (size_t i = 0; i < N_SPECTRUM_SAMPLES; i += Lanes::width) {
+        Lanes::store(out + i, op(Lanes::load(a + i), Lanes::load(b + i)));
+    }
+}
+
+// out[i] = op(a[i], c)
+template <auto op>
+void apply(float* out, const float* a, float c) {
+    auto cs = Lanes::broadcast(c);
+    for (size_t i = 0; i < N_SPECTRUM_SAMPLES; i += Lanes::width) {
+        Lanes::store(out + i, op(Lanes::load(a + i), cs));
+    }
+}
+
+} // namespace spectrum_simd
+
+
+// whether paths carry values at sampled wavelengths, or linear sRGB
+// RGB renders can't show spectral effects like dispersion, but skip sampling and evaluating spectra
+enum class ColorMode {
+    SPECTRAL,
+    RGB
+};
+
+// in RGB mode, the first three samples of a path are red, green and blue, and the rest are unused
+// spectra that have no RGB value (like a conductor's IOR) are evaluated at these wavelengths for each
+constexpr std::array<float, 3> RGB_WAVELENGTHS = { 630.0f, 532.0f, 465.0f };
+static_assert(N_SPECTRUM_SAMPLES >= 3, "RGB mode needs at least 3 samples per path");
+
 
 class WavelengthSample {
 public:
@@ -15,67 +166,133 @@ public:
     WavelengthSample(
         SampleArray&& lambdas,
         SampleArray&& pdf
-    );
+    ) : m_lambdas(std::move(lambdas)), m_pdf(std::move(pdf)) {}
 
     WavelengthSample() {};
 
     static WavelengthSample uniform(float u, float lambda_min = LAMBDA_MIN, float lambda_max = LAMBDA_MAX);
+    // the samples for a path in RGB mode
+    static WavelengthSample rgb();
+    // uniform(u) in spectral mode, rgb() otherwise
+    static WavelengthSample sample(ColorMode mode, float u) {
+        return mode == ColorMode::RGB ? rgb() : uniform(u);
+    }
 
-    bool secondary_terminated() const;
+    bool is_rgb() const { return m_rgb; }
 
-    void terminate_secondary();
+    // the wavelength that quantities that can take only one value per path (like a dielectric's IOR)
+    // are evaluated at
+    float hero() const { return m_rgb ? RGB_WAVELENGTHS[1] : m_lambdas[0]; }
+
+    bool secondary_terminated() const {
+        for (size_t i = 1; i < N_SPECTRUM_SAMPLES; i++) {
+            if (m_pdf[i] != 0.0f) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // RGB paths have no secondary wavelengths to terminate, so this does nothing for them
+    void terminate_secondary() {
+        if (m_rgb || secondary_terminated()) {
+            return;
+        }
+        for (size_t i = 1; i < N_SPECTRUM_SAMPLES; i++) {
+            m_pdf[i] = 0.0f;
+        }
+        m_pdf[0] /= N_SPECTRUM_SAMPLES;
+    }
 
     float operator[](size_t i) const { return m_lambdas[i]; }
 
-    bool operator==(const WavelengthSample& other) const;
+    bool operator==(const WavelengthSample& other) const {
+        return m_lambdas == other.m_lambdas && m_pdf == other.m_pdf && m_rgb == other.m_rgb;
+    }
 
-    SampleArray m_lambdas;
-    SampleArray m_pdf;
+    alignas(spectrum_simd::ALIGNMENT) SampleArray m_lambdas;
+    alignas(spectrum_simd::ALIGNMENT) SampleArray m_pdf;
+    bool m_rgb = false;
 };
 
 
 class SpectrumSample {
+    using Lanes = spectrum_simd::Lanes;
+
 public:
     using SampleArray = std::array<float, N_SPECTRUM_SAMPLES>;
 
     explicit SpectrumSample(const SampleArray& values) : m_values(values) {}
     explicit SpectrumSample(SampleArray&& values) : m_values(std::move(values)) {}
-    
+
     explicit SpectrumSample(float c) {
         m_values.fill(c);
     }
 
     SpectrumSample() : m_values({}) {}
 
+    // in RGB mode this evaluates spectrum at RGB_WAVELENGTHS, which suits physical quantities like IORs
+    // reflectances and illuminants should be converted to RGB instead, see RGBColorSpace
     static SpectrumSample from_spectrum(const Spectrum& spectrum, const WavelengthSample& wavelengths);
 
+    // the sample for linear sRGB values in RGB mode
+    static SpectrumSample from_rgb(float r, float g, float b) {
+        SpectrumSample sample;
+        sample.m_values[0] = r;
+        sample.m_values[1] = g;
+        sample.m_values[2] = b;
+        return sample;
+    }
+
     float operator[](size_t i) const { return m_values[i]; }
     float& operator[](size_t i) { return m_values[i]; }
 
-    bool is_zero() const;
+    bool is_zero() const {
+        for (size_t i = 0; i < N_SPECTRUM_SAMPLES; i += Lanes::width) {
+            if (Lanes::any_nonzero(Lanes::load(m_values.data() + i))) {
+                return false;
+            }
+        }
+        return true;
+    }
 
-    float max_component() const;
+    float max_component() const {
+        float max = m_values[0];
+        for (size_t i = 1; i < N_SPECTRUM_SAMPLES; ++i) {
+            if (m_values[i] > max) {
+                max = m_values[i];
+            }
+        }
+        return max;
+    }
 
     // arithmetic operators
-    SpectrumSample operator+(const SpectrumSample& other) const;
-    SpectrumSample& operator+=(const SpectrumSample& other);
-    SpectrumSample operator-(const SpectrumSample& other) const;
-    SpectrumSample& operator-=(const SpectrumSample& other);
-    SpectrumSample operator*(const SpectrumSample& other);
-    SpectrumSample& operator*=(const SpectrumSample& other);
-    SpectrumSample operator/(const SpectrumSample& other) const;
-    SpectrumSample& operator/=(const SpectrumSample& other);
-
-    SpectrumSample operator+(float c) const;
-    SpectrumSample& operator+=(float c);
-    SpectrumSample operator-(float c) const;
-    SpectrumSample& operator-=(float c);
-    SpectrumSample operator*(float c) const;
-    SpectrumSample& operator*=(float c);
-    SpectrumSample operator/(float c) const;
-    SpectrumSample& operator/=(float c);
-
-    float average() const;
+    // dividing by 0 gives 0 rather than inf or NaN
+    SpectrumSample operator+(const SpectrumSample& other) const { return combine<Lanes::add>(other); }
+    SpectrumSample& operator+=(const SpectrumSample& other) { return combine_inplace<Lanes::add>(other); }
+    SpectrumSample operator-(const SpectrumSample& other) const { return combine<Lanes::sub>(other); }
+    SpectrumSample& operator-=(const SpectrumSample& other) { return combine_inplace<Lanes::sub>(other); }
+    SpectrumSample operator*(const SpectrumSample& other) const { return combine<Lanes::mul>(other); }
+    SpectrumSample& operator*=(const SpectrumSample& other) { return combine_inplace<Lanes::mul>(other); }
+    SpectrumSample operator/(const SpectrumSample& other) const { return combine<Lanes::safe_div>(other); }
+    SpectrumSample& operator/=(const SpectrumSample& other) { return combine_inplace<Lanes::safe_div>(other); }
+
+    SpectrumSample operator+(float c) const { return combine<Lanes::add>(c); }
+    SpectrumSample& operator+=(float c) { return combine_inplace<Lanes::add>(c); }
+    SpectrumSample operator-(float c) const { return combine<Lanes::sub>(c); }
+    SpectrumSample& operator-=(float c) { return combine_inplace<Lanes::sub>(c); }
+    SpectrumSample operator*(float c) const { return combine<Lanes::mul>(c); }
+    SpectrumSample& operator*=(float c) { return combine_inplace<Lanes::mul>(c); }
+    SpectrumSample operator/(float c) const { return combine<Lanes::safe_div>(c); }
+    SpectrumSample& operator/=(float c) { return combine_inplace<Lanes::safe_div>(c); }
+
+    float average() const {
+        float sum = 0.0f;
+        for (size_t i = 0; i < N_SPECTRUM_SAMPLES; ++i) {
+            sum += m_values[i];
+        }
+        return sum / N_SPECTRUM_SAMPLES;
+    }
 
     // pointwise map
     template <typename F>
@@ -95,8 +312,27 @@ public:
     }
 
     // construct new spectrum from wavelengths pdf
-    static SpectrumSample from_wavelengths_pdf(const WavelengthSample& wavelengths);
+    static SpectrumSample from_wavelengths_pdf(const WavelengthSample& wavelengths) {
+        return SpectrumSample(wavelengths.m_pdf);
+    }
 
-    SampleArray m_values;
-};
+    alignas(spectrum_simd::ALIGNMENT) SampleArray m_values;
+
+private:
+    // other is either a SpectrumSample or a float
+    template <auto op, typename T>
+    SpectrumSample combine(const T& other) const {
+        alignas(spectrum_simd::ALIGNMENT) SampleArray values;
+        spectrum_simd::apply<op>(values.data(), m_values.data(), operand(other));
+        return SpectrumSample(std::move(values));
+    }
 
+    template <auto op, typename T>
+    SpectrumSample& combine_inplace(const T& other) {
+        spectrum_simd::apply<op>(m_values.data(), m_values.data(), operand(other));
+        return *this;
+    }
+
+    static const float* operand(const SpectrumSample& s) { return s.m_values.data(); }
+    static float operand(float c) { return c; }
+};
@@ -0,0 +1,155 @@
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "spectrum_sample.hpp"
+
+// check that SpectrumSample's SIMD arithmetic gives exactly what plain loops over its values do
+
+using SampleArray = SpectrumSample::SampleArray;
+
+// the scalar versions, as SpectrumSample computed them before it used SIMD
+SampleArray scalar(const SampleArray& a, const SampleArray& b, const std::function<float(float, float)>& op) {
+    SampleArray values;
+    for (size_t i = 0; i < N_SPECTRUM_SAMPLES; ++i) {
+        values[i] = op(a[i], b[i]);
+    }
+    return values;
+}
+
+float scalar_div(float a, float b) {
+    return b == 0.0f ? 0.0f : a / b;
+}
+
+bool scalar_is_zero(const SampleArray& a) {
+    for (size_t i = 0; i < N_SPECTRUM_SAMPLES; ++i) {
+        if (a[i] != 0.0f) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// equal bit for bit, except that any two NaNs are equal, since their payloads may depend on operand order
+bool same(float a, float b) {
+    if (a != a && b != b) {
+        return true;
+    }
+    return std::memcmp(&a, &b, sizeof(float)) == 0;
+}
+
+bool same(const SampleArray& a, const SampleArray& b) {
+    for (size_t i = 0; i < N_SPECTRUM_SAMPLES; ++i) {
+        if (!same(a[i], b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main() {
+    std::mt19937 rng(12345);
+    // mostly ordinary values, with enough zeros, signed zeros, infinities, NaNs and denormals to hit every case
+    std::vector<float> special = {
+        0.0f, -0.0f, 1.0f, -1.0f,
+        std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(),
+        std::numeric_limits<float>::quiet_NaN(), std::numeric_limits<float>::denorm_min(),
+        std::numeric_limits<float>::max(), std::numeric_limits<float>::min()
+    };
+    std::uniform_real_distribution<float> value(-10.0f, 10.0f);
+    std::uniform_int_distribution<size_t> pick(0, 3 * special.size());
+    auto random_float = [&]() {
+        size_t i = pick(rng);
+        return i < special.size() ? special[i] : value(rng);
+    };
+    auto random_array = [&]() {
+        SampleArray a;
+        for (auto& v : a) {
+            v = random_float();
+        }
+        return a;
+    };
+
+    size_t n_failures = 0;
+    auto check = [&](const std::string& name, const SampleArray& expected, const SampleArray& actual) {
+        if (!same(expected, actual)) {
+            if (n_failures < 10) {
+                std::cout << name << " differs:";
+                for (size_t i = 0; i < N_SPECTRUM_SAMPLES; ++i) {
+                    std::cout << " " << expected[i] << "/" << actual[i];
+                }
+                std::cout << std::endl;
+            }
+            n_failures++;
+        }
+    };
+
+    const size_t n_tests = 100000;
+    for (size_t t = 0; t < n_tests; ++t) {
+        SampleArray a = random_array();
+        SampleArray b = random_array();
+        float c = random_float();
+        SampleArray cs;
+        cs.fill(c);
+        SpectrumSample sa(a);
+        SpectrumSample sb(b);
+
+        check("+", scalar(a, b, std::plus<float>()), (sa + sb).m_values);
+        check("-", scalar(a, b, std::minus<float>()), (sa - sb).m_values);
+        check("*", scalar(a, b, std::multiplies<float>()), (sa * sb).m_values);
+        check("/", scalar(a, b, scalar_div), (sa / sb).m_values);
+        check("+ c", scalar(a, cs, std::plus<float>()), (sa + c).m_values);
+        check("- c", scalar(a, cs, std::minus<float>()), (sa - c).m_values);
+        check("* c", scalar(a, cs, std::multiplies<float>()), (sa * c).m_values);
+        check("/ c", scalar(a, cs, scalar_div), (sa / c).m_values);
+
+        SpectrumSample s = sa;
+        s += sb;
+        check("+=", scalar(a, b, std::plus<float>()), s.m_values);
+        s = sa;
+        s -= sb;
+        check("-=", scalar(a, b, std::minus<float>()), s.m_values);
+        s = sa;
+        s *= sb;
+        check("*=", scalar(a, b, std::multiplies<float>()), s.m_values);
+        s = sa;
+        s /= sb;
+        check("/=", scalar(a, b, scalar_div), s.m_values);
+        s = sa;
+        s /= c;
+        check("/= c", scalar(a, cs, scalar_div), s.m_values);
+        // an operand can be the sample itself
+        s = sa;
+        s *= s;
+        check("*= self", scalar(a, a, std::multiplies<float>()), s.m_values);
+
+        if (scalar_is_zero(a) != sa.is_zero()) {
+            std::cout << "is_zero differs" << std::endl;
+            n_failures++;
+        }
+    }
+    // is_zero rarely sees all zeros above, so check it directly too
+    for (float zero : { 0.0f, -0.0f }) {
+        SampleArray a;
+        a.fill(zero);
+        for (size_t i = 0; i <= N_SPECTRUM_SAMPLES; ++i) {
+            SampleArray b = a;
+            if (i < N_SPECTRUM_SAMPLES) {
+                b[i] = std::numeric_limits<float>::quiet_NaN();
+            }
+            if (scalar_is_zero(b) != SpectrumSample(b).is_zero()) {
+                std::cout << "is_zero differs" << std::endl;
+                n_failures++;
+            }
+        }
+    }
+
+    std::cout << "SIMD lanes: " << spectrum_simd::Lanes::width << ", " << n_failures << " mismatches in "
+        << n_tests << " tests" << std::endl;
+    return n_failures == 0 ? 0 : 1;
+}
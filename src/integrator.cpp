@@ -0,0 +1,216 @@
+#include <array>
+#include <cassert>
+#include <cmath>
+
+#include "integrator.hpp"
+
+float power_heuristic(int n_f, float f_pdf, int n_g, float g_pdf) {
+    float f = n_f * f_pdf;
+    float g = n_g * g_pdf;
+    if (std::isinf(f * f)) {
+        return 1.0f;
+    }
+    return f * f / (f * f + g * g);
+}
+
+std::optional<UnoccludedLightSample> sample_lights_unoccluded(
+    const Scene& scene,
+    const SurfaceInteraction& si,
+    const BSDF& bsdf,
+    const WavelengthSample& wavelengths,
+    Sampler& sampler
+) {
+    auto [light, sample_proba] = scene.sample_lights(si.point, si.normal, sampler);
+    // need to do this regardless of early exit in order to keep sampler depth even
+    Vec2 sample2 = sampler.sample_2d();
+    if (!light) {
+        sampler.sample_2d();  
+        return std::nullopt;
+    }
+    auto ls = light->sample(si, wavelengths, sample2);
+    if (!ls || ls->spec.is_zero() || ls->pdf == 0.0f) {
+        return std::nullopt;
+    }
+    Vec3 wo = si.wo;
+    Vec3 wi = ls->wi;
+    auto f = bsdf(wo, wi) * std::abs(wi.dot(si.normal));
+    if (f.is_zero()) {
+        return std::nullopt;
+    }
+    float p_l = sample_proba * ls->pdf;
+    SpectrumSample spec;
+    if (light->type() == LightType::AREA) {
+        float p_b = bsdf.pdf(wo, wi);
+        float w_l = power_heuristic(1, p_l, 1, p_b);
+        spec = ls->spec * f * (w_l / p_l);
+    }
+    else {
+        spec = ls->spec * f / p_l;
+    }
+    return UnoccludedLightSample {
+        .spec = spec,
+        .start = si.point,
+        .end = ls->p_light
+    };
+}
+
+SpectrumSample sample_lights(
+    const Scene& scene,
+    const SurfaceInteraction& si,
+    const BSDF& bsdf,
+    const WavelengthSample& wavelengths,
+    Sampler& sampler
+) {
+    auto uls = sample_lights_unoccluded(scene, si, bsdf, wavelengths, sampler);
+    if (!uls || scene.occluded(uls->start, uls->end)) {
+        return SpectrumSample(0.0f);
+    }
+    return uls->spec;
+}
+
+SpectrumSample sample_albedo(const SurfaceInteraction& si, const BSDF& bsdf) {
+    const size_t N_ALBEDO_SAMPLES = 16;
+    const std::array<float, N_ALBEDO_SAMPLES> uc = {
+        0.75741637, 0.37870818, 0.7083487, 0.18935409, 0.9149363, 0.35417435,
+        0.5990858,  0.09467703, 0.8578725, 0.45746812, 0.686759,  0.17708716,
+        0.9674518,  0.2995429,  0.5083201, 0.047338516
+    };
+    const std::array<Vec2, N_ALBEDO_SAMPLES> u2 = {
+        Vec2(0.855985, 0.570367), Vec2(0.381823, 0.851844),
+        Vec2(0.285328, 0.764262), Vec2(0.733380, 0.114073),
+        Vec2(0.542663, 0.344465), Vec2(0.127274, 0.414848),
+        Vec2(0.964700, 0.947162), Vec2(0.594089, 0.643463),
+        Vec2(0.095109, 0.170369), Vec2(0.825444, 0.263359),
+        Vec2(0.429467, 0.454469), Vec2(0.244460, 0.816459),
+        Vec2(0.756135, 0.731258), Vec2(0.516165, 0.152852),
+        Vec2(0.180888, 0.214174), Vec2(0.898579, 0.503897)
+    };
+
+    return bsdf.rho_hd(si.wo, uc, u2);
+}
+
+PixelSample sample_pixel(
+    Ray ray,
+    const Scene& scene,
+    WavelengthSample& wavelengths,
+    Sampler& sampler,
+    Arena& arena,
+    size_t max_bounces
+) {
+    auto si = scene.ray_intersect(ray, wavelengths, sampler);
+    return sample_pixel(ray, std::move(si), scene, wavelengths, sampler, arena, max_bounces);
+}
+
+// the heavy lifting goes on here
+PixelSample sample_pixel(
+    Ray ray,
+    std::optional<SurfaceInteraction> si,
+    const Scene& scene,
+    WavelengthSample& wavelengths,
+    Sampler& sampler,
+    Arena& arena,
+    size_t max_bounces
+) {
+    // nothing from an earlier sample is still in use
+    arena.reset();
+    PixelSample pxs{};
+    SpectrumSample weight(1.0f);
+    size_t depth = 0;
+    bool specular_bounce = false;
+    bool any_nonspecular_bounce = false;
+    float p_b = 1.0f;
+    float ior_scale = 1.0f;
+    Pt3 last_p;
+    Vec3 last_normal;
+    while (true) {
+        // no intersection, add background and break
+        if (!si) {
+            auto bg_light = scene.get_bg_light();
+            if (bg_light.spectrum) {
+                pxs.color += weight * bg_light.emission(wavelengths);
+            }
+            break;
+        }
+        if (depth == 0) {
+            pxs.normal = si->normal;
+        }
+        // add emitted light if intersected object is an area light
+        auto emitted = si->emission(-ray.d, wavelengths);
+        if (!emitted.is_zero()) {
+            if (depth == 0 || specular_bounce) {
+                pxs.color += weight * emitted;
+            }
+            else {
+                // compute importance-sampled weight for area light
+                auto light = si->light;
+                assert(light);
+                float light_proba = scene.light_sample_pmf(last_p, last_normal, light)
+                    * light->pdf(last_p, ray.d);
+                float light_weight = power_heuristic(1, p_b, 1, light_proba);
+
+                pxs.color += emitted * (weight * light_weight);
+            }
+        }
+        if (depth == max_bounces) {
+            break;
+        }
+
+        auto bsdf = si->bsdf(ray, wavelengths, sampler.sample_1d(), arena, scene.material_dispatch());
+        if (!bsdf) {
+            // I think this might mess up sample depth
+            // This should never happen now, but is something to pay attention to in the future
+            specular_bounce = true;
+            ray = si->skip_intersection(ray);
+            si = scene.ray_intersect(ray, wavelengths, sampler);
+            continue;
+        }
+
+        if (depth == 0) {
+            pxs.albedo = sample_albedo(*si, *bsdf);
+        }
+        
+        if (!bsdf->is_specular()) {
+            // sample direct illumination from light sources
+            pxs.color += weight * sample_lights(scene, *si, *bsdf, wavelengths, sampler);
+        }
+
+        auto bsdf_sample = bsdf->sample(si->wo, sampler.sample_1d(), sampler.sample_2d());
+        if (!bsdf_sample) {
+            break;
+        }
+        // if (depth == 0) {
+        //     pxs.albedo = bsdf_sample->spec;
+        // }
+
+        weight *= bsdf_sample->spec * std::abs(bsdf_sample->wi.dot(si->normal)) / bsdf_sample->pdf;
+
+        p_b = bsdf_sample->pdf_is_proportional ? bsdf->pdf(si->wo, bsdf_sample->wi) : bsdf_sample->pdf;
+        specular_bounce = bsdf_sample->scatter_type.specular;
+        any_nonspecular_bounce |= !specular_bounce;
+        if (bsdf_sample->scatter_type.transmission) {
+            ior_scale *= bsdf_sample->ior;
+        }
+        last_p = si->point;
+        last_normal = si->normal;
+
+        ray = Ray(si->point, bsdf_sample->wi);
+        depth++;
+
+        // maybe terminate early (russian roulette)
+        float roulette_sample = sampler.sample_1d();
+        auto rr_weight = weight * ior_scale;
+        if (rr_weight.max_component() < 1.f && depth > 1) {
+            float q = std::max(0.0f, 1.0f - rr_weight.max_component());
+            if (roulette_sample < q) {
+                break;
+            }
+            weight /= 1.0f - q;
+        }
+        if (weight.is_zero()) {
+            break;
+        }
+        si = scene.ray_intersect(ray, wavelengths, sampler);
+    }
+
+    return pxs;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <optional>
+
+#include "arena.hpp"
+#include "color/color.hpp"
+#include "bxdf.hpp"
+#include "interaction.hpp"
+#include "ray.hpp"
+#include "sampler.hpp"
+#include "scene.hpp"
+#include "vec.hpp"
+
+// building blocks of the path tracer, shared by the path-at-a-time and wavefront integrators
+
+// the result of tracing a single path
+struct PixelSample {
+    SpectrumSample color;
+    Vec3 normal;
+    SpectrumSample albedo;
+
+    PixelSample() : color(0.0f), normal(0.0f, 0.0f, 0.0f), albedo(0.0f) {}
+    PixelSample(
+        const Vec3& normal,
+        const SpectrumSample& albedo
+    ) : color(0.0f), normal(normal), albedo(albedo) {}
+
+    PixelSample& operator+=(const PixelSample& other) {
+        color += other.color;
+        normal += other.normal;
+        albedo += other.albedo;
+        return *this;
+    }
+
+    PixelSample& operator/=(float c) {
+        color /= c;
+        normal /= c;
+        albedo /= c;
+        return *this;
+    }
+};
+
+float power_heuristic(int n_f, float f_pdf, int n_g, float g_pdf);
+
+// light arriving at a surface from a sampled light source, before checking whether anything blocks it
+struct UnoccludedLightSample {
+    // contribution to the path, already multiplied by the bsdf and MIS weight
+    SpectrumSample spec;
+    // the segment that must be unoccluded for this light to count
+    Pt3 start;
+    Pt3 end;
+};
+
+// sample one light source for direct illumination at si, but leave the visibility test to the caller
+std::optional<UnoccludedLightSample> sample_lights_unoccluded(
+    const Scene& scene,
+    const SurfaceInteraction& si,
+    const BSDF& bsdf,
+    const WavelengthSample& wavelengths,
+    Sampler& sampler
+);
+
+// sample one light source for direct illumination at si
+SpectrumSample sample_lights(
+    const Scene& scene,
+    const SurfaceInteraction& si,
+    const BSDF& bsdf,
+    const WavelengthSample& wavelengths,
+    Sampler& sampler
+);
+
+// estimate the albedo of a surface from a fixed set of samples
+SpectrumSample sample_albedo(const SurfaceInteraction& si, const BSDF& bsdf);
+
+// computes a single sample on a single pixel
+// the BxDFs at each bounce are made in arena, which is reset at the start of every sample
+PixelSample sample_pixel(
+    Ray ray,
+    const Scene& scene,
+    WavelengthSample& wavelengths,
+    Sampler& sampler,
+    Arena& arena,
+    size_t max_bounces
+);
+
+// same as above, but starting from an intersection of the camera ray that has already been found
+PixelSample sample_pixel(
+    Ray ray,
+    std::optional<SurfaceInteraction> si,
+    const Scene& scene,
+    WavelengthSample& wavelengths,
+    Sampler& sampler,
+    Arena& arena,
+    size_t max_bounces
+);
\ No newline at end of file
@@ -1,8 +1,11 @@
 #pragma once
 
+#include <cmath>
+
 #include "bxdf.hpp"
 #include "light.hpp"
 #include "material.hpp"
+#include "ray.hpp"
 #include "vec.hpp"
 
 struct Interaction {
@@ -22,11 +25,20 @@ struct SurfaceInteraction : public Interaction {
         const AreaLight* light
     ) : Interaction { point, wo, normal, uv }, material(material), light(light) {}
 
-    std::optional<BSDF> bsdf(const Ray& ray, WavelengthSample& wavelengths, float sample) const {
+    std::optional<BSDF> bsdf(
+        const Ray& ray,
+        WavelengthSample& wavelengths,
+        float sample,
+        Arena& arena,
+        MaterialDispatch dispatch = MaterialDispatch::VIRTUAL
+    ) const {
         if (!material) {
             return std::nullopt;
         }
-        return material->bsdf(*this, wavelengths, sample);
+        if (dispatch == MaterialDispatch::CLOSED) {
+            return closed_bsdf(*material, *this, wavelengths, sample, arena);
+        }
+        return material->bsdf(*this, wavelengths, sample, arena);
     }
 
     SpectrumSample emission(const Vec3 w, const WavelengthSample& wavelengths) const {
@@ -40,6 +52,45 @@ struct SurfaceInteraction : public Interaction {
         return Ray(point, ray.d);
     }
 
+    // set duvdx and duvdy from where the differentials of the ray that hit this point meet its tangent plane
+    void compute_differentials(const RayDifferentials& differentials) {
+        // how far the point moves to where a differential ray meets the plane, or zero if it misses it
+        auto dp = [&](const Ray& r) {
+            float denom = normal.dot(r.d);
+            if (denom == 0.0f) {
+                return Vec3();
+            }
+            float t = normal.dot(point - r.o) / denom;
+            return Vec3(r.at(t) - point);
+        };
+        Vec3 dpdx = dp(differentials.rx);
+        Vec3 dpdy = dp(differentials.ry);
+
+        // solve dp = dpdu * du + dpdv * dv for du and dv, by least squares
+        float a00 = dpdu.dot(dpdu);
+        float a01 = dpdu.dot(dpdv);
+        float a11 = dpdv.dot(dpdv);
+        float inv_det = 1.0f / (a00 * a11 - a01 * a01);
+        if (!std::isfinite(inv_det)) {
+            return;
+        }
+        auto duv = [&](const Vec3& dp) {
+            float b0 = dpdu.dot(dp);
+            float b1 = dpdv.dot(dp);
+            Vec2 d((a11 * b0 - a01 * b1) * inv_det, (a00 * b1 - a01 * b0) * inv_det);
+            return std::isfinite(d.x) && std::isfinite(d.y) ? d : Vec2();
+        };
+        duvdx = duv(dpdx);
+        duvdy = duv(dpdy);
+    }
+
     const Material* material;
     const Light* light;
+    // how the point moves with uv; zero where that isn't known
+    Vec3 dpdu;
+    Vec3 dpdv;
+    // how uv changes from one pixel to the next, which textures filter over
+    // zero, for the finest texture detail, unless compute_differentials was called
+    Vec2 duvdx;
+    Vec2 duvdy;
 };
\ No newline at end of file
@@ -1,13 +1,24 @@
+#include <cassert>
+#include <cmath>
+
+#include "color/rgb.hpp"
 #include "interaction.hpp"
 #include "light.hpp"
 
+Light::Light(std::shared_ptr<const Spectrum> spectrum, float scale, LightType type) : m_spectrum(spectrum), m_scale(scale), m_type(type) {
+    // unlike the background light, a light always emits something
+    assert(spectrum);
+    RGB rgb = RGBColorSpace::sRGB()->illuminant_rgb(*spectrum);
+    m_rgb = SpectrumSample::from_rgb(rgb.x, rgb.y, rgb.z);
+}
+
 SpectrumSample PointLight::total_emission(const WavelengthSample& wavelengths) const {
-    return SpectrumSample::from_spectrum(*m_spectrum, wavelengths) * (4.0f * M_PI * m_scale);
+    return spectrum_sample(wavelengths) * (4.0f * M_PI * m_scale);
 }
 
 std::optional<LightSample> PointLight::sample(const SurfaceInteraction& si, const WavelengthSample& wavelengths, Vec2 _sample2) const {
     Vec3 wi = (m_point - si.point).normalized();
-    auto spec = SpectrumSample::from_spectrum(*m_spectrum, wavelengths) * (m_scale / (m_point - si.point).norm_squared());
+    auto spec = spectrum_sample(wavelengths) * (m_scale / (m_point - si.point).norm_squared());
     return LightSample {
         .spec = spec,
         .wi = wi,
@@ -18,11 +29,30 @@ std::optional<LightSample> PointLight::sample(const SurfaceInteraction& si, cons
 
 
 SpectrumSample AreaLight::total_emission(const WavelengthSample& wavelengths) const {
-    auto spec = SpectrumSample::from_spectrum(*m_spectrum, wavelengths);
+    auto spec = spectrum_sample(wavelengths);
     return spec * (M_PI * (m_two_sided ? 2.0f : 1.0f) * m_shape->area() * m_scale);
 }
 
 
+namespace {
+
+// convert a pdf per unit area at a point on a light to one per unit solid angle as seen from p
+// 0 if the light is seen edge on, since no direction then reaches it
+float solid_angle_pdf(float area_pdf, const Pt3& p, const Pt3& p_light, const Vec3& n_light) {
+    Vec3 d = p_light - p;
+    float dist_squared = d.norm_squared();
+    if (dist_squared == 0.0f) {
+        return 0.0f;
+    }
+    float cos_light = std::abs(n_light.dot(d)) / std::sqrt(dist_squared);
+    if (cos_light == 0.0f) {
+        return 0.0f;
+    }
+    return area_pdf * dist_squared / cos_light;
+}
+
+} // namespace
+
 std::optional<LightSample> AreaLight::sample(const SurfaceInteraction& si, const WavelengthSample& wavelengths, Vec2 sample2) const {
     auto ss = m_shape->sample_point(sample2);
     if (ss.pdf == 0.0f || (ss.p - si.point).norm_squared() == 0.0f) {
@@ -30,24 +60,29 @@ std::optional<LightSample> AreaLight::sample(const SurfaceInteraction& si, const
     }
     Vec3 wi = (ss.p - si.point).normalized();
     auto spec = emission(ss.p, ss.normal, -wi, wavelengths);
-    if (spec.is_zero()) {
+    float pdf = solid_angle_pdf(ss.pdf, si.point, ss.p, ss.normal);
+    if (spec.is_zero() || pdf == 0.0f) {
         return std::nullopt;
     }
     return LightSample {
         .spec = spec,
         .wi = wi,
-        .pdf = ss.pdf,
+        .pdf = pdf,
         .p_light = ss.p
     };
 }
 
 float AreaLight::pdf(const Pt3& p, const Vec3& wi) const {
-    return m_shape->pdf(p);
+    auto hit = m_shape->intersect(p, wi.normalized());
+    if (!hit) {
+        return 0.0f;
+    }
+    return solid_angle_pdf(hit->pdf, p, hit->p, hit->normal);
 }
 
 SpectrumSample AreaLight::emission(const Pt3& p, const Vec3& n, const Vec3& w, const WavelengthSample& wavelengths) const {
     if (!m_two_sided && n.dot(w) < 0.0f) {
         return SpectrumSample(0.0f);
     }
-    return SpectrumSample::from_spectrum(*m_spectrum, wavelengths) * m_scale;
+    return spectrum_sample(wavelengths) * m_scale;
 }
@@ -10,6 +10,7 @@ struct SurfaceInteraction;
 struct LightSample {
     SpectrumSample spec;
     Vec3 wi;
+    // per unit solid angle around wi, so that it's comparable with a BSDF's pdf (1 for a light at a single point)
     float pdf;
     Pt3 p_light;
 };
@@ -24,13 +25,14 @@ class Light {
 public:
     virtual ~Light() {}
 
-    Light(std::shared_ptr<const Spectrum> spectrum, float scale, LightType type) : m_spectrum(spectrum), m_scale(scale), m_type(type) {}
+    // spectrum mustn't be null
+    Light(std::shared_ptr<const Spectrum> spectrum, float scale, LightType type);
     
     virtual SpectrumSample total_emission(const WavelengthSample& wavelengths) const = 0;
 
     // sample light received at point on surface (si refers to surface receiving light, not the light itself)
     virtual std::optional<LightSample> sample(const SurfaceInteraction& si, const WavelengthSample& wavelengths, Vec2 sample2) const = 0;
-    // get pdf for light from source, along wi to point p
+    // get pdf for light from source, along wi to point p, per unit solid angle
     // note that here p is the point that receives the light, not a point on the light
     virtual float pdf(const Pt3& p, const Vec3& wi) const {
         return 0.0f;
@@ -46,10 +48,33 @@ public:
         return m_type;
     }
 
+    // the light's position among its scene's lights, which light samplers keep their tables in
+    size_t index() const {
+        return m_index;
+    }
+    void set_index(size_t index) {
+        m_index = index;
+    }
+
+    // replace the light's spectrum with one that's cheaper to evaluate, see SpectrumBaker
+    void bake_spectra(SpectrumBaker& baker) {
+        baker.bake(m_spectrum);
+    }
+
 protected:
+    // the light's spectrum at the given wavelengths, or its RGB for an RGB path
+    SpectrumSample spectrum_sample(const WavelengthSample& wavelengths) const {
+        if (wavelengths.is_rgb()) {
+            return m_rgb;
+        }
+        return SpectrumSample::from_spectrum(*m_spectrum, wavelengths);
+    }
+
     std::shared_ptr<const Spectrum> m_spectrum;
+    SpectrumSample m_rgb;
     float m_scale;
     LightType m_type;
+    size_t m_index = 0;
 };
 
 
@@ -0,0 +1,125 @@
+#include <algorithm>
+
+#include "light_sampler.hpp"
+#include "util.hpp"
+
+namespace {
+
+// whether light is one of lights, found by its index rather than a search
+bool in_lights(const std::vector<const Light*>& lights, const Light* light) {
+    return light && light->index() < lights.size() && lights[light->index()] == light;
+}
+
+} // namespace
+
+std::unique_ptr<LightSampler> make_light_sampler(LightSampling sampling, const std::vector<std::unique_ptr<Light>>& lights) {
+    switch (sampling) {
+    case LightSampling::UNIFORM:
+        return std::make_unique<UniformLightSampler>(lights);
+    case LightSampling::POWER:
+        return std::make_unique<PowerLightSampler>(lights);
+    }
+    return nullptr;
+}
+
+AliasTable::AliasTable(const std::vector<float>& weights) : m_bins(weights.size()) {
+    size_t n = weights.size();
+    double sum = 0.0;
+    for (float weight : weights) {
+        sum += weight;
+    }
+    // each index's probability, scaled so that a bin holds 1
+    std::vector<double> scaled(n);
+    for (size_t i = 0; i < n; i++) {
+        double p = sum > 0.0 ? weights[i] / sum : 1.0 / n;
+        m_bins[i].pmf = p;
+        scaled[i] = p * n;
+    }
+
+    // fill each bin with less than its share from one with more
+    std::vector<size_t> under;
+    std::vector<size_t> over;
+    for (size_t i = 0; i < n; i++) {
+        (scaled[i] < 1.0 ? under : over).push_back(i);
+    }
+    while (!under.empty() && !over.empty()) {
+        size_t small = under.back();
+        under.pop_back();
+        size_t large = over.back();
+        over.pop_back();
+        m_bins[small].q = scaled[small];
+        m_bins[small].alias = large;
+        scaled[large] -= 1.0 - scaled[small];
+        (scaled[large] < 1.0 ? under : over).push_back(large);
+    }
+    // whatever's left holds (up to rounding) exactly its share
+    for (size_t i : under) {
+        m_bins[i] = { .q = 1.0f, .alias = static_cast<uint32_t>(i), .pmf = m_bins[i].pmf };
+    }
+    for (size_t i : over) {
+        m_bins[i] = { .q = 1.0f, .alias = static_cast<uint32_t>(i), .pmf = m_bins[i].pmf };
+    }
+}
+
+size_t AliasTable::sample(float u) const {
+    float scaled = u * m_bins.size();
+    size_t i = std::min(static_cast<size_t>(scaled), m_bins.size() - 1);
+    // the rest of u picks between the bin's index and its alias
+    float up = std::min(scaled - i, ONE_MINUS_EPS);
+    return up < m_bins[i].q ? i : m_bins[i].alias;
+}
+
+UniformLightSampler::UniformLightSampler(const std::vector<std::unique_ptr<Light>>& lights) {
+    for (const auto& light : lights) {
+        m_lights.push_back(light.get());
+    }
+}
+
+std::pair<const Light*, float> UniformLightSampler::sample(const Pt3& point, const Vec3& normal, float u) const {
+    if (m_lights.empty()) {
+        return {nullptr, 0.0f};
+    }
+    size_t i = static_cast<size_t>(u * m_lights.size());
+    return {m_lights[i], 1.0f / m_lights.size()};
+}
+
+float UniformLightSampler::pmf(const Pt3& point, const Vec3& normal, const Light* light) const {
+    if (!in_lights(m_lights, light)) {
+        return 0.0f;
+    }
+    return 1.0f / m_lights.size();
+}
+
+PowerLightSampler::PowerLightSampler(const std::vector<std::unique_ptr<Light>>& lights) {
+    // average each light's emission over wavelengths spread evenly across the visible range
+    const size_t n_wavelength_samples = 16;
+    std::vector<float> powers;
+    for (const auto& light : lights) {
+        double power = 0.0;
+        for (size_t i = 0; i < n_wavelength_samples; i++) {
+            auto wavelengths = WavelengthSample::uniform((i + 0.5f) / n_wavelength_samples);
+            SpectrumSample emission = light->total_emission(wavelengths);
+            for (size_t j = 0; j < N_SPECTRUM_SAMPLES; j++) {
+                power += emission[j];
+            }
+        }
+        m_lights.push_back(light.get());
+        powers.push_back(power / (n_wavelength_samples * N_SPECTRUM_SAMPLES));
+    }
+    m_table = AliasTable(powers);
+}
+
+std::pair<const Light*, float> PowerLightSampler::sample(const Pt3& point, const Vec3& normal, float u) const {
+    if (m_lights.empty()) {
+        return {nullptr, 0.0f};
+    }
+    size_t i = m_table.sample(u);
+    return {m_lights[i], m_table.pmf(i)};
+}
+
+float PowerLightSampler::pmf(const Pt3& point, const Vec3& normal, const Light* light) const {
+    if (!in_lights(m_lights, light)) {
+        return 0.0f;
+    }
+    return m_table.pmf(light->index());
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "light.hpp"
+#include "vec.hpp"
+
+// how a scene chooses which light to sample at each bounce
+// UNIFORM picks every light equally often; POWER picks lights in proportion to the power they emit, so that dim
+// lights get few shadow rays
+enum class LightSampling {
+    UNIFORM,
+    POWER
+};
+
+// chooses a light to sample from a point on a surface
+// samplers are built from a scene's lights when it's committed, and may use the point and normal to favor the lights
+// that matter most there
+class LightSampler {
+public:
+    virtual ~LightSampler() = default;
+
+    // a light for the given uniform sample in [0, 1), and the probability of choosing it; nullptr if there are none
+    virtual std::pair<const Light*, float> sample(const Pt3& point, const Vec3& normal, float u) const = 0;
+    // the probability of sample choosing light at the given point; 0 for lights that aren't in the scene
+    virtual float pmf(const Pt3& point, const Vec3& normal, const Light* light) const = 0;
+};
+
+std::unique_ptr<LightSampler> make_light_sampler(LightSampling sampling, const std::vector<std::unique_ptr<Light>>& lights);
+
+
+// samples indices in proportion to their weights in constant time, by Vose's alias method
+// each index gets an equal share of [0, 1), which it splits with one other index (its alias)
+class AliasTable {
+public:
+    AliasTable() = default;
+    // weights needn't sum to 1; if they're all 0, every index is equally likely
+    explicit AliasTable(const std::vector<float>& weights);
+
+    size_t sample(float u) const;
+    float pmf(size_t i) const {
+        return m_bins[i].pmf;
+    }
+    size_t size() const {
+        return m_bins.size();
+    }
+
+private:
+    struct Bin {
+        // the part of the bin's share that goes to its own index, rather than its alias
+        float q;
+        uint32_t alias;
+        float pmf;
+    };
+
+    std::vector<Bin> m_bins;
+};
+
+
+class UniformLightSampler : public LightSampler {
+public:
+    explicit UniformLightSampler(const std::vector<std::unique_ptr<Light>>& lights);
+
+    std::pair<const Light*, float> sample(const Pt3& point, const Vec3& normal, float u) const override;
+    float pmf(const Pt3& point, const Vec3& normal, const Light* light) const override;
+
+private:
+    std::vector<const Light*> m_lights;
+};
+
+
+// picks lights in proportion to their total emission, averaged over the visible wavelengths
+// this ignores where the lights are, so a bright light far away still gets most shadow rays
+class PowerLightSampler : public LightSampler {
+public:
+    explicit PowerLightSampler(const std::vector<std::unique_ptr<Light>>& lights);
+
+    std::pair<const Light*, float> sample(const Pt3& point, const Vec3& normal, float u) const override;
+    float pmf(const Pt3& point, const Vec3& normal, const Light* light) const override;
+
+private:
+    std::vector<const Light*> m_lights;
+    AliasTable m_table;
+};
@@ -0,0 +1,129 @@
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "color/spectrum.hpp"
+#include "light_sampler.hpp"
+
+// check that alias tables and light samplers choose indices and lights as often as their pmfs say
+
+namespace {
+
+int n_failures = 0;
+
+void check(bool ok, const std::string& name, const std::string& what) {
+    if (!ok) {
+        std::cout << name << ": " << what << std::endl;
+        n_failures++;
+    }
+}
+
+// how often each index comes up for evenly spread samples in [0, 1)
+std::vector<double> frequencies(const AliasTable& table, size_t n_samples) {
+    std::vector<double> counts(table.size());
+    for (size_t i = 0; i < n_samples; i++) {
+        counts[table.sample((i + 0.5f) / n_samples)]++;
+    }
+    for (double& count : counts) {
+        count /= n_samples;
+    }
+    return counts;
+}
+
+void check_table(const std::string& name, const std::vector<float>& weights) {
+    AliasTable table(weights);
+    check(table.size() == weights.size(), name, "wrong size");
+    double sum = 0.0;
+    for (float weight : weights) {
+        sum += weight;
+    }
+    std::vector<double> freq = frequencies(table, 1 << 20);
+    for (size_t i = 0; i < weights.size(); i++) {
+        double expected = sum > 0.0 ? weights[i] / sum : 1.0 / weights.size();
+        std::string index = "index " + std::to_string(i);
+        check(std::abs(table.pmf(i) - expected) < 1e-6, name, index + " has pmf " + std::to_string(table.pmf(i))
+            + ", expected " + std::to_string(expected));
+        check(std::abs(freq[i] - table.pmf(i)) < 1e-3, name, index + " came up " + std::to_string(freq[i])
+            + " of the time, but has pmf " + std::to_string(table.pmf(i)));
+        if (weights[i] == 0.0f && sum > 0.0) {
+            check(freq[i] == 0.0, name, index + " has no weight, but came up");
+        }
+    }
+}
+
+std::vector<std::unique_ptr<Light>> point_lights(const std::vector<float>& scales) {
+    std::vector<std::unique_ptr<Light>> lights;
+    for (float scale : scales) {
+        lights.push_back(std::make_unique<PointLight>(
+            Pt3(0.0f, 0.0f, 0.0f),
+            std::make_shared<ConstantSpectrum>(1.0f),
+            scale
+        ));
+        // as Scene::add_light does
+        lights.back()->set_index(lights.size() - 1);
+    }
+    return lights;
+}
+
+void check_sampler(const std::string& name, const LightSampler& sampler, const std::vector<std::unique_ptr<Light>>& lights,
+    const std::vector<float>& expected) {
+    Pt3 point(1.0f, 2.0f, 3.0f);
+    Vec3 normal(0.0f, 1.0f, 0.0f);
+    const size_t n_samples = 1 << 16;
+    std::vector<double> freq(lights.size());
+    for (size_t i = 0; i < n_samples; i++) {
+        auto [light, pmf] = sampler.sample(point, normal, (i + 0.5f) / n_samples);
+        if (!light || light->index() >= lights.size() || lights[light->index()].get() != light) {
+            check(false, name, "sampled a light that isn't in the scene");
+            return;
+        }
+        if (pmf != sampler.pmf(point, normal, light)) {
+            check(false, name, "sample and pmf disagree for light " + std::to_string(light->index()));
+            return;
+        }
+        freq[light->index()] += 1.0 / n_samples;
+    }
+    for (size_t i = 0; i < lights.size(); i++) {
+        std::string light = "light " + std::to_string(i);
+        float pmf = sampler.pmf(point, normal, lights[i].get());
+        check(std::abs(pmf - expected[i]) < 1e-6f, name, light + " has pmf " + std::to_string(pmf) + ", expected "
+            + std::to_string(expected[i]));
+        check(std::abs(freq[i] - pmf) < 1e-3, name, light + " came up " + std::to_string(freq[i])
+            + " of the time, but has pmf " + std::to_string(pmf));
+    }
+
+    // lights of another scene, including one with the same index as a light of this one, and no light at all
+    auto others = point_lights({ 1.0f });
+    check(sampler.pmf(point, normal, others[0].get()) == 0.0f, name, "a light that isn't in the scene has a pmf");
+    check(sampler.pmf(point, normal, nullptr) == 0.0f, name, "no light has a pmf");
+}
+
+} // namespace
+
+int main() {
+    check_table("uneven weights", { 1.0f, 0.0f, 3.0f, 0.5f, 0.0f, 2.5f, 0.001f });
+    check_table("one weight", { 2.0f });
+    check_table("zero weights", { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f });
+
+    // a light's power is proportional to its scale
+    std::vector<float> scales = { 1.0f, 0.0f, 4.0f, 3.0f };
+    auto lights = point_lights(scales);
+    check_sampler("power", PowerLightSampler(lights), lights, { 0.125f, 0.0f, 0.5f, 0.375f });
+    check_sampler("uniform", UniformLightSampler(lights), lights, { 0.25f, 0.25f, 0.25f, 0.25f });
+    auto dark = point_lights({ 0.0f, 0.0f });
+    check_sampler("no power", PowerLightSampler(dark), dark, { 0.5f, 0.5f });
+
+    std::vector<std::unique_ptr<Light>> none;
+    for (LightSampling sampling : { LightSampling::UNIFORM, LightSampling::POWER }) {
+        auto sampler = make_light_sampler(sampling, none);
+        Pt3 point(0.0f, 0.0f, 0.0f);
+        Vec3 normal(0.0f, 0.0f, 1.0f);
+        check(sampler->sample(point, normal, 0.5f).first == nullptr, "no lights", "sampled a light");
+        check(sampler->pmf(point, normal, lights[0].get()) == 0.0f, "no lights", "a light has a pmf");
+    }
+
+    std::cout << n_failures << " failures" << std::endl;
+    return n_failures == 0 ? 0 : 1;
+}
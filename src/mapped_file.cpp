@@ -0,0 +1,54 @@
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mapped_file.hpp"
+
+std::optional<MappedFile> MappedFile::open(const std::string& filename, bool sequential) {
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return std::nullopt;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return std::nullopt;
+    }
+    size_t size = static_cast<size_t>(st.st_size);
+    // mmap doesn't accept a length of 0, but an empty file is still a valid file
+    if (size == 0) {
+        close(fd);
+        return MappedFile(nullptr, 0);
+    }
+    void* ptr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping keeps its own reference to the file
+    close(fd);
+    if (ptr == MAP_FAILED) {
+        return std::nullopt;
+    }
+    madvise(ptr, size, sequential ? MADV_SEQUENTIAL : MADV_WILLNEED);
+    return MappedFile(static_cast<const char*>(ptr), size);
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : m_data(std::exchange(other.m_data, nullptr)), m_size(std::exchange(other.m_size, 0)) {}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        if (m_data) {
+            munmap(const_cast<char*>(m_data), m_size);
+        }
+        m_data = std::exchange(other.m_data, nullptr);
+        m_size = std::exchange(other.m_size, 0);
+    }
+    return *this;
+}
+
+MappedFile::~MappedFile() {
+    if (m_data) {
+        munmap(const_cast<char*>(m_data), m_size);
+    }
+}
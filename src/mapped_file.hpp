@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// a whole file mapped read-only into memory
+// the contents are paged in by the OS as they're touched, rather than copied into a buffer up front
+class MappedFile {
+public:
+    // returns nullopt if the file can't be opened or mapped
+    // a file that's read front to back once should be opened as sequential, so that the OS reads ahead aggressively;
+    // otherwise the whole file is read ahead, on the assumption that all of it will be used soon
+    static std::optional<MappedFile> open(const std::string& filename, bool sequential = true);
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    ~MappedFile();
+
+    const char* data() const {
+        return m_data;
+    }
+    size_t size() const {
+        return m_size;
+    }
+    std::string_view view() const {
+        return std::string_view(m_data, m_size);
+    }
+
+private:
+    MappedFile(const char* data, size_t size) : m_data(data), m_size(size) {}
+
+    const char* m_data = nullptr;
+    size_t m_size = 0;
+};
@@ -1,22 +1,46 @@
 #include "interaction.hpp"
 #include "material.hpp"
 
-BSDF DiffuseMaterial::bsdf(const SurfaceInteraction& si, WavelengthSample& wavelengths, float _sample) const {
-    auto r = m_texture->value(si.uv, si.point, wavelengths);
-    return BSDF(
-        si.normal,
-        std::make_unique<DiffuseBxDF>(std::move(r))
-    );
+BSDF closed_bsdf(const Material& material, const SurfaceInteraction& si, WavelengthSample& wavelengths, float sample, Arena& arena) {
+    // each case calls a non-virtual function defined below, so the compiler can inline it
+    switch (material.type()) {
+    case MaterialType::DIFFUSE:
+        return BSDF(si.normal, static_cast<const DiffuseMaterial&>(material).bxdf(si, wavelengths));
+    case MaterialType::CONDUCTIVE:
+        return BSDF(si.normal, static_cast<const ConductiveMaterial&>(material).bxdf(si, wavelengths));
+    case MaterialType::DIELECTRIC:
+        return BSDF(si.normal, static_cast<const DielectricMaterial&>(material).bxdf(si, wavelengths));
+    case MaterialType::THIN_DIELECTRIC:
+        return BSDF(si.normal, static_cast<const ThinDielectricMaterial&>(material).bxdf(si, wavelengths));
+    case MaterialType::MIXED:
+        return closed_bsdf(static_cast<const MixedMaterialBase&>(material).choose(sample), si, wavelengths, sample, arena);
+    default:
+        return material.bsdf(si, wavelengths, sample, arena);
+    }
+}
+
+BSDF DiffuseMaterial::bsdf(const SurfaceInteraction& si, WavelengthSample& wavelengths, float _sample, Arena& arena) const {
+    return BSDF(si.normal, arena.make<DiffuseBxDF>(bxdf(si, wavelengths)));
+}
+
+DiffuseBxDF DiffuseMaterial::bxdf(const SurfaceInteraction& si, WavelengthSample& wavelengths) const {
+    auto r = m_texture->value(TextureContext {
+        .uv = si.uv,
+        .point = si.point,
+        .duvdx = si.duvdx,
+        .duvdy = si.duvdy
+    }, wavelengths);
+    return DiffuseBxDF(std::move(r));
+}
+
+BSDF ConductiveMaterial::bsdf(const SurfaceInteraction& si, WavelengthSample& wavelengths, float _sample, Arena& arena) const {
+    return BSDF(si.normal, arena.make<ConductorBxDF>(bxdf(si, wavelengths)));
 }
 
-BSDF ConductiveMaterial::bsdf(const SurfaceInteraction& si, WavelengthSample& wavelengths, float _sample) const {
+ConductorBxDF ConductiveMaterial::bxdf(const SurfaceInteraction& si, WavelengthSample& wavelengths) const {
     auto ior = SpectrumSample::from_spectrum(*m_ior, wavelengths);
     auto absorption = SpectrumSample::from_spectrum(*m_absorption, wavelengths);
-
-    return BSDF(
-        si.normal,
-        std::make_unique<ConductorBxDF>(std::move(ior), std::move(absorption), m_roughness)
-    );
+    return ConductorBxDF(std::move(ior), std::move(absorption), m_roughness);
 }
 
 ConductiveMaterial ConductiveMaterial::alluminum(float roughness_a, float roughness_b) {
@@ -35,26 +59,26 @@ ConductiveMaterial ConductiveMaterial::copper(float roughness_a, float roughness
     );
 }
 
-BSDF DielectricMaterial::bsdf(const SurfaceInteraction& si, WavelengthSample& wavelengths, float _sample) const {
-    float ior = (*m_ior)(wavelengths[0]);
+BSDF DielectricMaterial::bsdf(const SurfaceInteraction& si, WavelengthSample& wavelengths, float _sample, Arena& arena) const {
+    return BSDF(si.normal, arena.make<DielectricBxDF>(bxdf(si, wavelengths)));
+}
+
+DielectricBxDF DielectricMaterial::bxdf(const SurfaceInteraction& si, WavelengthSample& wavelengths) const {
+    float ior = (*m_ior)(wavelengths.hero());
     if (!is_constant) {
         wavelengths.terminate_secondary();
     }
+    return DielectricBxDF(ior);
+}
 
-    return BSDF(
-        si.normal,
-        std::make_unique<DielectricBxDF>(ior)
-    );
+BSDF ThinDielectricMaterial::bsdf(const SurfaceInteraction& si, WavelengthSample& wavelengths, float _sample, Arena& arena) const {
+    return BSDF(si.normal, arena.make<ThinDielectricBxDF>(bxdf(si, wavelengths)));
 }
 
-BSDF ThinDielectricMaterial::bsdf(const SurfaceInteraction& si, WavelengthSample& wavelengths, float _sample) const {
-    float ior = (*m_ior)(wavelengths[0]);
+ThinDielectricBxDF ThinDielectricMaterial::bxdf(const SurfaceInteraction& si, WavelengthSample& wavelengths) const {
+    float ior = (*m_ior)(wavelengths.hero());
     if (!is_constant) {
         wavelengths.terminate_secondary();
     }
-
-    return BSDF(
-        si.normal,
-        std::make_unique<ThinDielectricBxDF>(ior)
-    );
+    return ThinDielectricBxDF(ior);
 }
@@ -2,7 +2,9 @@
 
 #include <algorithm>
 #include <cassert>
+#include <vector>
 
+#include "arena.hpp"
 #include "bxdf.hpp"
 #include "color/color.hpp"
 #include "sampler.hpp"
@@ -13,20 +15,58 @@
 
 struct SurfaceInteraction;
 
+// the built-in materials, which closed-set dispatch can call without going through their vtables
+enum class MaterialType {
+    OTHER,
+    DIFFUSE,
+    CONDUCTIVE,
+    DIELECTRIC,
+    THIN_DIELECTRIC,
+    MIXED
+};
+
+// how a SurfaceInteraction finds its material's BSDF
+// VIRTUAL calls Material::bsdf; CLOSED switches on the material's type, so that the built-in materials'
+// code can be inlined and their BxDFs held by value (other materials still go through bsdf)
+enum class MaterialDispatch {
+    VIRTUAL,
+    CLOSED
+};
+
 class Material {
 public:
-    virtual BSDF bsdf(const SurfaceInteraction& si, WavelengthSample& wavelengths, float sample) const = 0;
+    explicit Material(MaterialType type = MaterialType::OTHER) : m_type(type) {}
+    virtual ~Material() = default;
+
+    // the BSDF's BxDF is made in arena, so it's only valid until the arena is reset
+    virtual BSDF bsdf(const SurfaceInteraction& si, WavelengthSample& wavelengths, float sample, Arena& arena) const = 0;
+
+    // replace the material's spectra with ones that are cheaper to evaluate, see SpectrumBaker
+    virtual void bake_spectra(SpectrumBaker& baker) {}
+
+    MaterialType type() const { return m_type; }
+
+private:
+    MaterialType m_type;
 };
 
+// get a material's BSDF by switching on its type; see MaterialDispatch
+BSDF closed_bsdf(const Material& material, const SurfaceInteraction& si, WavelengthSample& wavelengths, float sample, Arena& arena);
+
 
 class DiffuseMaterial : public Material {
 public:
-    explicit DiffuseMaterial(std::unique_ptr<Texture>&& texture) : m_texture(std::move(texture)) {}
+    explicit DiffuseMaterial(std::unique_ptr<Texture>&& texture) : Material(MaterialType::DIFFUSE), m_texture(std::move(texture)) {}
 
     template <typename T>
-    explicit DiffuseMaterial(T&& texture) : m_texture(std::make_unique<T>(std::forward<T>(texture))) {}
+    explicit DiffuseMaterial(T&& texture) : Material(MaterialType::DIFFUSE), m_texture(std::make_unique<T>(std::forward<T>(texture))) {}
 
-    BSDF bsdf(const SurfaceInteraction& si, WavelengthSample& wavelengths, float sample) const override;
+    BSDF bsdf(const SurfaceInteraction& si, WavelengthSample& wavelengths, float sample, Arena& arena) const override;
+    DiffuseBxDF bxdf(const SurfaceInteraction& si, WavelengthSample& wavelengths) const;
+
+    void bake_spectra(SpectrumBaker& baker) override {
+        m_texture->bake_spectra(baker);
+    }
 
     std::unique_ptr<Texture> m_texture;
 };
@@ -34,15 +74,21 @@ public:
 
 class ConductiveMaterial : public Material {
 public:
-    ConductiveMaterial(float ior, float absorption) : m_ior(std::make_shared<ConstantSpectrum>(ior)), m_absorption(std::make_shared<ConstantSpectrum>(absorption)), m_roughness(0.0f, 0.0f) {}
+    ConductiveMaterial(float ior, float absorption) : Material(MaterialType::CONDUCTIVE), m_ior(std::make_shared<ConstantSpectrum>(ior)), m_absorption(std::make_shared<ConstantSpectrum>(absorption)), m_roughness(0.0f, 0.0f) {}
 
     ConductiveMaterial(
         std::shared_ptr<const Spectrum> ior,
         std::shared_ptr<const Spectrum> absorption,
         TrowbridgeReitzDistribution roughness = TrowbridgeReitzDistribution(0.0f, 0.0f)
-    ) : m_ior(ior), m_absorption(absorption), m_roughness(roughness) {}
+    ) : Material(MaterialType::CONDUCTIVE), m_ior(ior), m_absorption(absorption), m_roughness(roughness) {}
 
-    BSDF bsdf(const SurfaceInteraction& si, WavelengthSample& wavelengths, float sample) const override;
+    BSDF bsdf(const SurfaceInteraction& si, WavelengthSample& wavelengths, float sample, Arena& arena) const override;
+    ConductorBxDF bxdf(const SurfaceInteraction& si, WavelengthSample& wavelengths) const;
+
+    void bake_spectra(SpectrumBaker& baker) override {
+        baker.bake(m_ior);
+        baker.bake(m_absorption);
+    }
 
     static ConductiveMaterial alluminum(float roughness_a = 0.0f, float roughness_b = 0.0f);
     static ConductiveMaterial copper(float roughness_a = 0.0f, float roughness_b = 0.0f);
@@ -55,11 +101,16 @@ public:
 
 class DielectricMaterial : public Material {
 public:
-    explicit DielectricMaterial(float ior) : m_ior(std::make_shared<ConstantSpectrum>(ior)), is_constant(true) {}
+    explicit DielectricMaterial(float ior) : Material(MaterialType::DIELECTRIC), m_ior(std::make_shared<ConstantSpectrum>(ior)), is_constant(true) {}
 
-    explicit DielectricMaterial(std::shared_ptr<const Spectrum> ior) : m_ior(ior), is_constant(false) {}
+    explicit DielectricMaterial(std::shared_ptr<const Spectrum> ior) : Material(MaterialType::DIELECTRIC), m_ior(ior), is_constant(false) {}
 
-    BSDF bsdf(const SurfaceInteraction& si, WavelengthSample& wavelengths, float sample) const override;
+    BSDF bsdf(const SurfaceInteraction& si, WavelengthSample& wavelengths, float sample, Arena& arena) const override;
+    DielectricBxDF bxdf(const SurfaceInteraction& si, WavelengthSample& wavelengths) const;
+
+    void bake_spectra(SpectrumBaker& baker) override {
+        baker.bake(m_ior);
+    }
 
     bool is_constant;
     std::shared_ptr<const Spectrum> m_ior;
@@ -68,21 +119,47 @@ public:
 
 class ThinDielectricMaterial : public Material {
 public:
-    explicit ThinDielectricMaterial(float ior) : m_ior(std::make_shared<ConstantSpectrum>(ior)), is_constant(true) {}
+    explicit ThinDielectricMaterial(float ior) : Material(MaterialType::THIN_DIELECTRIC), m_ior(std::make_shared<ConstantSpectrum>(ior)), is_constant(true) {}
     
-    explicit ThinDielectricMaterial(std::shared_ptr<const Spectrum> ior) : m_ior(ior), is_constant(false) {}
+    explicit ThinDielectricMaterial(std::shared_ptr<const Spectrum> ior) : Material(MaterialType::THIN_DIELECTRIC), m_ior(ior), is_constant(false) {}
 
-    BSDF bsdf(const SurfaceInteraction& si, WavelengthSample& wavelengths, float sample) const override;
+    BSDF bsdf(const SurfaceInteraction& si, WavelengthSample& wavelengths, float sample, Arena& arena) const override;
+    ThinDielectricBxDF bxdf(const SurfaceInteraction& si, WavelengthSample& wavelengths) const;
+
+    void bake_spectra(SpectrumBaker& baker) override {
+        baker.bake(m_ior);
+    }
 
     bool is_constant;
     std::shared_ptr<const Spectrum> m_ior;
 };
 
 
-template <size_t N>
-class MixedMaterial : public Material {
+// picks one of several materials at random for each sample
+// everything but the constructor lives here rather than in MixedMaterial, so that closed-set dispatch can
+// reach it without knowing N
+class MixedMaterialBase : public Material {
 public:
-    explicit MixedMaterial(std::array<std::unique_ptr<Material>, N>&& materials, std::array<float, N>&& weights) : m_materials(std::move(materials)), m_weights(std::move(weights)) {
+    BSDF bsdf(const SurfaceInteraction& si, WavelengthSample& wavelengths, float sample, Arena& arena) const override {
+        return choose(sample).bsdf(si, wavelengths, sample, arena);
+    }
+
+    void bake_spectra(SpectrumBaker& baker) override {
+        for (auto& material : m_materials) {
+            material->bake_spectra(baker);
+        }
+    }
+
+    const Material& choose(float sample) const {
+        size_t idx = sample * m_materials.size();
+        return *m_materials[idx];
+    }
+
+    std::vector<std::unique_ptr<Material>> m_materials;
+    std::vector<float> m_weights;
+
+protected:
+    MixedMaterialBase(std::vector<std::unique_ptr<Material>>&& materials, std::vector<float>&& weights) : Material(MaterialType::MIXED), m_materials(std::move(materials)), m_weights(std::move(weights)) {
         float weight_sum = std::accumulate(m_weights.begin(), m_weights.end(), 0.0f);
         assert(weight_sum > 0.0f);
         // normalize weights to sum to 1
@@ -90,12 +167,14 @@ public:
             return w / weight_sum;
         });
     }
-    
-    BSDF bsdf(const SurfaceInteraction& si, WavelengthSample& wavelengths, float sample) const override {
-        size_t idx = sample * m_materials.size();
-        return m_materials[idx]->bsdf(si, wavelengths, sample);
-    }
+};
+
 
-    std::array<std::unique_ptr<Material>, N> m_materials;
-    std::array<float, N> m_weights;
+template <size_t N>
+class MixedMaterial : public MixedMaterialBase {
+public:
+    explicit MixedMaterial(std::array<std::unique_ptr<Material>, N>&& materials, std::array<float, N>&& weights) : MixedMaterialBase(
+        std::vector<std::unique_ptr<Material>>(std::make_move_iterator(materials.begin()), std::make_move_iterator(materials.end())),
+        std::vector<float>(weights.begin(), weights.end())
+    ) {}
 };
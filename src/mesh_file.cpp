@@ -0,0 +1,118 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#include "mesh_file.hpp"
+
+namespace {
+
+// every buffer starts on a multiple of this many bytes
+const uint64_t BUFFER_ALIGNMENT = 16;
+
+uint64_t align(uint64_t offset) {
+    return (offset + BUFFER_ALIGNMENT - 1) / BUFFER_ALIGNMENT * BUFFER_ALIGNMENT;
+}
+
+// whether a buffer of count elements of the given size (plus padding bytes) fits in the file at offset
+bool buffer_fits(uint64_t offset, uint64_t count, uint64_t element_size, uint64_t file_size, uint64_t padding = 0) {
+    if (offset % BUFFER_ALIGNMENT != 0 || offset > file_size || file_size - offset < padding) {
+        return false;
+    }
+    return count <= (file_size - offset - padding) / element_size;
+}
+
+// whether every index is below n, allowing -1 if allow_unset is set
+template <typename T>
+bool indices_in_range(const T* indices, size_t count, uint64_t n, bool allow_unset = false) {
+    return std::all_of(indices, indices + count, [&](T i) {
+        // negative values wrap around to large ones here
+        return (allow_unset && i == T(-1)) || static_cast<uint64_t>(i) < n;
+    });
+}
+
+// append count elements to the file at the next aligned offset, followed by padding bytes of zeros
+// offset is the current end of the file; returns the offset the elements were written at
+template <typename T>
+uint64_t write_buffer(std::ofstream& file, uint64_t& offset, const T* data, size_t count, uint64_t padding = 0) {
+    static const char zeros[BUFFER_ALIGNMENT] = {};
+    uint64_t start = align(offset);
+    file.write(zeros, start - offset);
+    file.write(reinterpret_cast<const char*>(data), count * sizeof(T));
+    file.write(zeros, padding);
+    offset = start + count * sizeof(T) + padding;
+    return start;
+}
+
+} // namespace
+
+std::optional<MeshFile> MeshFile::open(const std::string& filename) {
+    // embree reads the buffers in no particular order, so read the whole file ahead
+    auto mapped = MappedFile::open(filename, false);
+    if (!mapped || mapped->size() < sizeof(MeshFileHeader)) {
+        return std::nullopt;
+    }
+    MeshFile file(std::move(*mapped));
+    const MeshFileHeader& h = file.header();
+    if (std::memcmp(h.magic, MESH_FILE_MAGIC, sizeof(h.magic)) != 0 || h.version != MESH_FILE_VERSION) {
+        return std::nullopt;
+    }
+
+    uint64_t size = file.m_file.size();
+    bool has_normals = h.n_normals > 0;
+    bool fits = buffer_fits(h.vertices, h.n_vertices, 3 * sizeof(float), size, sizeof(float))
+        && buffer_fits(h.triangles, h.n_triangles, 3 * sizeof(unsigned int), size)
+        && buffer_fits(h.quads, h.n_quads, 4 * sizeof(unsigned int), size);
+    if (has_normals) {
+        fits = fits
+            && buffer_fits(h.normals, h.n_normals, 3 * sizeof(float), size)
+            && buffer_fits(h.triangle_normals, h.n_triangles, 3 * sizeof(int), size)
+            && buffer_fits(h.quad_normals, h.n_quads, 4 * sizeof(int), size);
+    }
+    if (!fits) {
+        return std::nullopt;
+    }
+
+    // an index outside the mesh would have embree read outside the file, so check them all once here
+    for (unsigned int face_size : { 3u, 4u }) {
+        size_t n_indices = face_size * file.n_faces(face_size);
+        if (!indices_in_range(file.faces(face_size), n_indices, h.n_vertices)) {
+            return std::nullopt;
+        }
+        if (has_normals && !indices_in_range(file.face_normals(face_size), n_indices, h.n_normals, true)) {
+            return std::nullopt;
+        }
+    }
+    return file;
+}
+
+bool write_mesh_file(const std::string& filename, const obj::MeshData& mesh) {
+    std::ofstream file(filename, std::ios::out | std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    MeshFileHeader header = {};
+    std::memcpy(header.magic, MESH_FILE_MAGIC, sizeof(header.magic));
+    header.version = MESH_FILE_VERSION;
+    header.n_vertices = mesh.n_vertices();
+    // normals that no face refers to aren't written, since a file with normals needs normal indices for every face
+    bool has_normals = mesh.has_normals();
+    header.n_normals = has_normals ? mesh.normals.size() : 0;
+    header.n_triangles = mesh.n_faces(3);
+    header.n_quads = mesh.n_faces(4);
+
+    // the header is written again at the end, once the buffer offsets are known
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    uint64_t offset = sizeof(header);
+    header.vertices = write_buffer(file, offset, mesh.vertices.data(), 3 * mesh.n_vertices(), sizeof(float));
+    header.normals = write_buffer(file, offset, mesh.normals.data(), header.n_normals);
+    header.triangles = write_buffer(file, offset, mesh.triangles.data(), mesh.triangles.size());
+    header.quads = write_buffer(file, offset, mesh.quads.data(), mesh.quads.size());
+    if (has_normals) {
+        header.triangle_normals = write_buffer(file, offset, mesh.triangle_normals.data(), mesh.triangle_normals.size());
+        header.quad_normals = write_buffer(file, offset, mesh.quad_normals.data(), mesh.quad_normals.size());
+    }
+
+    file.seekp(0);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    return static_cast<bool>(file);
+}
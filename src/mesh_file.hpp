@@ -0,0 +1,86 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+#include "mapped_file.hpp"
+#include "obj/obj.hpp"
+
+// binary mesh files hold a mesh in the layout embree reads, so that they can be mapped and used without parsing
+//
+// a file is a MeshFileHeader followed by these buffers, each starting at a multiple of 16 bytes into the file:
+//   vertices          n_vertices x float3, followed by 4 bytes of padding, since embree reads vertices 16 bytes at a time
+//   normals           n_normals x float3
+//   triangles         n_triangles x uint3 vertex indices
+//   quads             n_quads x uint4 vertex indices
+//   triangle normals  n_triangles x int3 normal indices (-1 for a corner without a normal)
+//   quad normals      n_quads x int4 normal indices
+// the normal buffers are empty if n_normals is 0
+// all values are in the byte order of the machine that wrote the file
+
+constexpr char MESH_FILE_MAGIC[8] = "QZMESH";
+constexpr uint32_t MESH_FILE_VERSION = 1;
+
+struct MeshFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t n_vertices;
+    uint64_t n_normals;
+    uint64_t n_triangles;
+    uint64_t n_quads;
+    // offset of each buffer from the start of the file, in bytes
+    uint64_t vertices;
+    uint64_t normals;
+    uint64_t triangles;
+    uint64_t quads;
+    uint64_t triangle_normals;
+    uint64_t quad_normals;
+};
+
+// a binary mesh file, mapped read-only into memory
+class MeshFile {
+public:
+    // returns nullopt if the file can't be mapped, or isn't a valid mesh file
+    static std::optional<MeshFile> open(const std::string& filename);
+
+    const MeshFileHeader& header() const {
+        return *at<MeshFileHeader>(0);
+    }
+    const float* vertices() const {
+        return at<float>(header().vertices);
+    }
+    // nullptr if the mesh has no normals
+    const std::array<float, 3>* normals() const {
+        return header().n_normals ? at<std::array<float, 3>>(header().normals) : nullptr;
+    }
+    size_t n_faces(unsigned int face_size) const {
+        return face_size == 3 ? header().n_triangles : header().n_quads;
+    }
+    // face_size (3 or 4) vertex indices per face, for the triangles or the quads
+    const unsigned int* faces(unsigned int face_size) const {
+        return at<unsigned int>(face_size == 3 ? header().triangles : header().quads);
+    }
+    // face_size normal indices per face; nullptr if the mesh has no normals
+    const int* face_normals(unsigned int face_size) const {
+        if (!header().n_normals) {
+            return nullptr;
+        }
+        return at<int>(face_size == 3 ? header().triangle_normals : header().quad_normals);
+    }
+
+private:
+    explicit MeshFile(MappedFile&& file) : m_file(std::move(file)) {}
+
+    template <typename T>
+    const T* at(uint64_t offset) const {
+        return reinterpret_cast<const T*>(m_file.data() + offset);
+    }
+
+    MappedFile m_file;
+};
+
+// write a mesh as a binary mesh file; returns false if the file can't be written
+bool write_mesh_file(const std::string& filename, const obj::MeshData& mesh);
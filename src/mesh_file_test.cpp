@@ -0,0 +1,81 @@
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <string>
+
+#include "mesh_file.hpp"
+#include "obj/obj.hpp"
+
+// check that meshes written as mesh files open again, with the same vertices, faces and normals
+
+namespace {
+
+int n_failures = 0;
+
+void check(bool ok, const std::string& name, const std::string& what) {
+    if (!ok) {
+        std::cout << name << ": " << what << std::endl;
+        n_failures++;
+    }
+}
+
+template <typename T>
+bool same(const T* a, const T* b, size_t count) {
+    return count == 0 || std::memcmp(a, b, count * sizeof(T)) == 0;
+}
+
+void round_trip(const std::string& name, const obj::MeshData& mesh, const std::string& filename) {
+    if (!write_mesh_file(filename, mesh)) {
+        check(false, name, "can't write " + filename);
+        return;
+    }
+    auto file = MeshFile::open(filename);
+    if (!file) {
+        check(false, name, "written file doesn't open");
+        return;
+    }
+    const MeshFileHeader& h = file->header();
+    check(h.n_vertices == mesh.n_vertices(), name, "vertex count differs");
+    check(same(file->vertices(), mesh.vertices.data(), 3 * mesh.n_vertices()), name, "vertices differ");
+    check((file->normals() != nullptr) == mesh.has_normals(), name, "normals are present in just one of them");
+    if (mesh.has_normals()) {
+        check(h.n_normals == mesh.normals.size(), name, "normal count differs");
+        check(same(file->normals(), mesh.normals.data(), mesh.normals.size()), name, "normals differ");
+    }
+    for (unsigned int face_size : { 3u, 4u }) {
+        check(file->n_faces(face_size) == mesh.n_faces(face_size), name, "face count differs");
+        check(same(file->faces(face_size), mesh.faces(face_size).data(), mesh.faces(face_size).size()), name,
+            "faces differ");
+        if (mesh.has_normals()) {
+            check(same(file->face_normals(face_size), mesh.face_normals(face_size).data(),
+                mesh.face_normals(face_size).size()), name, "face normals differ");
+        }
+    }
+}
+
+} // namespace
+
+int main() {
+    auto filename = (std::filesystem::temp_directory_path() / "mesh_file_test.mesh").string();
+
+    const std::string positions =
+        "v 0 0 0\n"
+        "v 1 0 0\n"
+        "v 1 1 0\n"
+        "v 0 1 0\n";
+    round_trip("no normals", obj::parse_obj(positions + "f 1 2 3\nf 1 2 3 4\n"), filename);
+    round_trip("normals", obj::parse_obj(positions + "vn 0 0 1\nf 1//1 2//1 3//1\nf 1//1 2//1 3//1 4//1\n"), filename);
+    round_trip("some corners without normals", obj::parse_obj(positions + "vn 0 0 1\nf 1//1 2 3\nf 1 2 3 4\n"), filename);
+    // normals that no face refers to
+    obj::MeshData unreferenced = obj::parse_obj(positions + "vn 0 0 1\nvn 0 1 0\nf 1 2 3\nf 1 2 3 4\n");
+    check(!unreferenced.has_normals() && unreferenced.normals.empty(), "unreferenced normals",
+        "normals are kept without face normals");
+    round_trip("unreferenced normals", unreferenced, filename);
+    // the same, put together by hand so that the normals are still there
+    unreferenced.normals = { { 0.0f, 0.0f, 1.0f }, { 0.0f, 1.0f, 0.0f } };
+    round_trip("normals without face normals", unreferenced, filename);
+
+    std::filesystem::remove(filename);
+    std::cout << n_failures << " failures" << std::endl;
+    return n_failures == 0 ? 0 : 1;
+}
@@ -1,179 +1,409 @@
 #include "obj.hpp"
-#include "regex.hpp"
+#include "mapped_file.hpp"
 
-#include <fstream>
+#include <algorithm>
+#include <charconv>
+#include <cstring>
 #include <iostream>
+#include <thread>
 
 namespace obj {
 
-std::optional<Vertex> Vertex::from_line(const std::string& line) {
-    regex::regex r("v\\s+(\\S+)\\s+(\\S+)\\s+(\\S+)(?:\\s+(\\S+))?");
-    regex::smatch match;
-    if (!regex::regex_search(line, match, r)) {
-        return std::nullopt;
+namespace {
+
+// pieces of a file smaller than this aren't worth a thread of their own
+const size_t MIN_CHUNK_SIZE = 1 << 22;
+
+bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+// pulls whitespace separated values off the front of a line, without copying anything
+class LineReader {
+public:
+    explicit LineReader(std::string_view line) : m_p(line.data()), m_end(line.data() + line.size()) {}
+
+    bool done() {
+        skip_space();
+        return m_p == m_end;
+    }
+
+    std::string_view token() {
+        skip_space();
+        const char* start = m_p;
+        while (m_p != m_end && !is_space(*m_p)) {
+            m_p++;
+        }
+        return std::string_view(start, m_p - start);
+    }
+
+    bool read_float(float& x) {
+        skip_space();
+        // from_chars doesn't accept an explicit plus sign, but stof (and exporters) do
+        if (m_p != m_end && *m_p == '+') {
+            m_p++;
+        }
+        auto [ptr, ec] = std::from_chars(m_p, m_end, x);
+        if (ec != std::errc()) {
+            return false;
+        }
+        m_p = ptr;
+        return true;
+    }
+
+private:
+    void skip_space() {
+        while (m_p != m_end && is_space(*m_p)) {
+            m_p++;
+        }
     }
-    float x = std::stof(match[1].str());
-    float y = std::stof(match[2].str());
-    float z = std::stof(match[3].str());
-    auto v = Vertex {
-        x, y, z
-    };
-    if (match[4].matched) {
-        v.w = std::stof(match[4].str());
+
+    const char* m_p;
+    const char* m_end;
+};
+
+// indices of a single face corner, as given in the file
+struct Corner {
+    int vertex = 0;
+    int texture = 0;
+    int normal = 0;
+    // whether vertex and normal were given as relative (negative) indices
+    bool relative_vertex = false;
+    bool relative_normal = false;
+};
+
+// a face with relative indices, as the index of its first corner in the triangles or quads
+// the mask has bit i set if vertex index i of the face is relative, and bit 4 + i if normal index i is
+struct RelativeFace {
+    unsigned int face_size;
+    size_t start;
+    uint8_t mask;
+};
+
+// the result of parsing one chunk of a file
+struct Chunk {
+    MeshData mesh;
+    // whether the mesh has normal indices; they're only stored once a face has normals,
+    // so meshes without them don't pay for them
+    bool has_normal_indices = false;
+    // relative indices can't be fully resolved until the number of vertices and normals in earlier chunks
+    // is known, so they're resolved against this chunk only, and the faces that use them are listed here
+    std::vector<RelativeFace> relative_faces;
+};
+
+// give every face of the mesh normal indices, with -1 for the faces that didn't have any
+void add_normal_indices(MeshData& mesh) {
+    for (unsigned int face_size : { 3u, 4u }) {
+        mesh.face_normals(face_size).resize(mesh.faces(face_size).size(), -1);
     }
-    return v;
 }
 
-std::optional<VertexNormal> VertexNormal::from_line(const std::string& line) {
-    regex::regex r("vn\\s+(\\S+)\\s+(\\S+)\\s+(\\S+)");
-    regex::smatch match;
-    if (!regex::regex_search(line, match, r)) {
-        return std::nullopt;
+// read one component of a corner, stopping at the next slash or the end of the token
+// an empty component (as in "1//3") is left as 0
+bool read_index(const char*& p, const char* end, int& index) {
+    if (p == end || *p == '/') {
+        return true;
+    }
+    auto [ptr, ec] = std::from_chars(p, end, index);
+    if (ec != std::errc() || (ptr != end && *ptr != '/')) {
+        return false;
+    }
+    p = ptr;
+    return true;
+}
+
+// parse a face corner such as "3", "3/1", "3//2" or "3/1/2"
+bool parse_corner(std::string_view token, Corner& corner) {
+    const char* p = token.data();
+    const char* end = p + token.size();
+    corner = Corner();
+    if (!read_index(p, end, corner.vertex) || corner.vertex == 0) {
+        return false;
+    }
+    if (p != end) {
+        p++;
+        if (!read_index(p, end, corner.texture)) {
+            return false;
+        }
+    }
+    if (p != end) {
+        p++;
+        if (!read_index(p, end, corner.normal)) {
+            return false;
+        }
     }
-    float x = std::stof(match[1].str());
-    float y = std::stof(match[2].str());
-    float z = std::stof(match[3].str());
-    return VertexNormal {
-        x, y, z
-    };
+    return p == end;
 }
 
-std::optional<FaceElement> FaceElement::from_line(const std::string& line) {
-    regex::regex r_only_vert("f\\s+(\\d+)\\s+(\\d+)\\s+(\\d+)(?:\\s+(\\d+))?");
-    regex::smatch match;
-    if (regex::regex_search(line, match, r_only_vert)) {
-        int a = std::stoi(match[1].str());
-        int b = std::stoi(match[2].str());
-        int c = std::stoi(match[3].str());
-        if (match[4].matched) {
-            int d = std::stoi(match[4].str());
-            return FaceElement {
-                .vertices = { a, b, c, d },
-                .n_vertices = 4
-            };
-        }
-        return FaceElement {
-            .vertices = { a, b, c, c },
-            .n_vertices = 3
-        };
-    }
-    regex::regex r_vert_tex("f\\s+(\\d+)\\/(\\d+)\\s+(\\d+)\\/(\\d+)\\s+(\\d+)\\/(\\d+)(?:\\s+(\\d+)\\/(\\d+))?");
-    if (regex::regex_search(line, match, r_vert_tex)) {
-        int va = std::stoi(match[1].str());
-        int ta = std::stoi(match[2].str());
-        int vb = std::stoi(match[3].str());
-        int tb = std::stoi(match[4].str());
-        int vc = std::stoi(match[5].str());
-        int tc = std::stoi(match[6].str());
-        if (match[7].matched) {
-            int vd = std::stoi(match[7].str());
-            int td = std::stoi(match[8].str());
-            return FaceElement {
-                .vertices = { va, vb, vc, vd },
-                .textures = { ta, tb, tc, td },
-                .n_vertices = 4
-            };
-        }
-        return FaceElement {
-            .vertices = { va, vb, vc, vc },
-            .textures = { ta, tb, tc, tc },
-            .n_vertices = 3
-        };
-    }
-    regex::regex r_vert_tex_norm("f\\s+(\\d+)\\/(\\d+)?\\/(\\d+)\\s+(\\d+)\\/(\\d+)?\\/(\\d+)\\s+(\\d+)\\/(\\d+)?\\/(\\d+)(?:\\s+(\\d+)\\/(\\d+)?\\/(\\d+))?");
-    if (regex::regex_search(line, match, r_vert_tex_norm)) {
-        int va = std::stoi(match[1].str());
-        int na = std::stoi(match[3].str());
-        int vb = std::stoi(match[4].str());
-        int nb = std::stoi(match[6].str());
-        int vc = std::stoi(match[7].str());
-        int nc = std::stoi(match[9].str());
-        FaceElement fe;
-        if (match[10].matched) {
-            int vd = std::stoi(match[10].str());
-            int nd = std::stoi(match[12].str());
-            fe.vertices = { va, vb, vc, vd };
-            fe.normals = { na, nb, nc, nd };
-            fe.n_vertices = 4;
-        }
-        else {
-            fe.vertices = { va, vb, vc, vc };
-            fe.normals = { na, nb, nc, nc };
-            fe.n_vertices = 3;
-        }
-        if (match[2].matched && match[5].matched && match[8].matched) {
-            fe.textures = {
-                std::stoi(match[2].str()),
-                std::stoi(match[5].str()),
-                std::stoi(match[8].str()),
-                match[11].matched ? std::stoi(match[11].str()) : 0
-            };
-        }
-        return fe;
-    }
-    return std::nullopt;
+bool parse_vertex(LineReader& reader, MeshData& mesh) {
+    float x, y, z;
+    if (!reader.read_float(x) || !reader.read_float(y) || !reader.read_float(z)) {
+        return false;
+    }
+    // an optional w may follow, but it isn't used
+    mesh.vertices.insert(mesh.vertices.end(), { x, y, z });
+    return true;
 }
 
-std::optional<ObjData> load_obj(const std::string& filename) {
-    std::cerr << "Loading " << filename << "..." <<std::endl;
-    std::ifstream file(filename);
-    if (!file.is_open()) {
-        std::cout << "Unable to open file " << filename << std::endl;
-        return std::nullopt;
+bool parse_vertex_normal(LineReader& reader, MeshData& mesh) {
+    std::array<float, 3> vn;
+    if (!reader.read_float(vn[0]) || !reader.read_float(vn[1]) || !reader.read_float(vn[2])) {
+        return false;
+    }
+    mesh.normals.push_back(vn);
+    return true;
+}
+
+// corners is scratch space, passed in so that its storage is reused from line to line
+bool parse_face(LineReader& reader, Chunk& chunk, std::vector<Corner>& corners) {
+    MeshData& mesh = chunk.mesh;
+    corners.clear();
+    bool has_normals = false;
+    while (!reader.done()) {
+        auto token = reader.token();
+        // the rest of the line is a comment
+        if (token[0] == '#') {
+            break;
+        }
+        Corner c;
+        if (!parse_corner(token, c)) {
+            return false;
+        }
+        // negative indices count back from the most recent element, with -1 being the last one read so far
+        // for now, only the elements of this chunk are counted
+        if (c.vertex < 0) {
+            c.vertex += static_cast<int>(mesh.n_vertices()) + 1;
+            c.relative_vertex = true;
+        }
+        if (c.normal < 0) {
+            c.normal += static_cast<int>(mesh.normals.size()) + 1;
+            c.relative_normal = true;
+        }
+        has_normals |= c.normal != 0 || c.relative_normal;
+        corners.push_back(c);
+    }
+    if (corners.size() < 3) {
+        return false;
     }
-    std::string line;
-    // TODO: allow textures and normals to be added afterward
-    ObjData obj_data;
-    while(std::getline(file, line)) {
-        regex::regex r_line_type("^\\S+");
-        regex::smatch match;
 
-        // skip comments
-        auto res = regex::regex_search(line, match, r_line_type);
-        if (!res || match.str()[0] == '#') {
-            continue;
-        
+    if (has_normals && !chunk.has_normal_indices) {
+        add_normal_indices(mesh);
+        chunk.has_normal_indices = true;
+    }
+
+    // split into a fan around the first corner, two triangles (one quad) at a time
+    for (size_t k = 1; k + 1 < corners.size(); k += 2) {
+        unsigned int face_size = k + 2 < corners.size() ? 4 : 3;
+        auto& faces = mesh.faces(face_size);
+        size_t start = faces.size();
+        uint8_t relative_mask = 0;
+        for (size_t i = 0; i < face_size; i++) {
+            const Corner& c = i == 0 ? corners[0] : corners[k + i - 1];
+            // invalid indices wrap around to large values here, and are caught once the whole file is read
+            faces.push_back(static_cast<unsigned int>(c.vertex - 1));
+            if (chunk.has_normal_indices) {
+                mesh.face_normals(face_size).push_back(c.normal - 1);
+            }
+            relative_mask |= (c.relative_vertex << i) | (c.relative_normal << (4 + i));
         }
-        auto line_type = match.str();
+        if (relative_mask) {
+            chunk.relative_faces.push_back({ face_size, start, relative_mask });
+        }
+    }
+    return true;
+}
 
+void parse_chunk(std::string_view text, Chunk& chunk) {
+    std::vector<Corner> corners;
+    const char* p = text.data();
+    const char* end = p + text.size();
+    while (p < end) {
+        const char* line_end = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        if (!line_end) {
+            line_end = end;
+        }
+        LineReader reader(std::string_view(p, line_end - p));
+        p = line_end + 1;
+
+        auto line_type = reader.token();
         // todo: handle objects and groups properly
-        // if (line_type == "g") {
-        //     // new object
-        //     regex::regex r_obj_name("g\\s+(\\S+)");
-        //     std::string obj_name = "";
-        //     if (regex::regex_search(line, match, r_obj_name)) {
-        //         obj_name = match[1].str();
-        //     }
-        //     objects.push_back(Object { obj_name });
-        //     current_obj = &objects.back();
-        //     continue;
-        // }
+        // texture coordinates (vt) are skipped for now, as are comments and anything else unrecognized
         if (line_type == "v") {
-            auto vert = Vertex::from_line(line);
-            if (vert) {
-                obj_data.vertices.push_back(*vert);
-            }
+            parse_vertex(reader, chunk.mesh);
         }
-        // else if (line_type == "vt") {
-        //     // ignore this for now
-        // }
         else if (line_type == "vn") {
-            auto vert_norm = VertexNormal::from_line(line);
-            if (vert_norm) {
-                obj_data.vertex_normals.push_back(*vert_norm);
-            }
+            parse_vertex_normal(reader, chunk.mesh);
         }
         else if (line_type == "f") {
-            auto face = FaceElement::from_line(line);
-            if (face) {
-                obj_data.faces.push_back(*face);
+            parse_face(reader, chunk, corners);
+        }
+    }
+}
+
+// finish resolving the relative indices of a chunk's faces
+// vertex_offset and normal_offset are the numbers of vertices and normals in all earlier chunks
+void resolve_relative_indices(Chunk& chunk, size_t vertex_offset, size_t normal_offset) {
+    MeshData& mesh = chunk.mesh;
+    for (const auto& face : chunk.relative_faces) {
+        unsigned int* indices = &mesh.faces(face.face_size)[face.start];
+        for (size_t i = 0; i < face.face_size; i++) {
+            if (face.mask & (1 << i)) {
+                indices[i] += static_cast<unsigned int>(vertex_offset);
+            }
+            if (face.mask & (1 << (4 + i))) {
+                mesh.face_normals(face.face_size)[face.start + i] += static_cast<int>(normal_offset);
+            }
+        }
+    }
+}
+
+// append a chunk to the combined mesh, then release the chunk's memory
+// if any chunk has normal indices, every chunk needs them, so has_normals pads out the ones without
+void append_chunk(MeshData& mesh, Chunk& chunk, bool has_normals) {
+    MeshData& part = chunk.mesh;
+    mesh.vertices.insert(mesh.vertices.end(), part.vertices.begin(), part.vertices.end());
+    mesh.normals.insert(mesh.normals.end(), part.normals.begin(), part.normals.end());
+    for (unsigned int face_size : { 3u, 4u }) {
+        auto& faces = mesh.faces(face_size);
+        faces.insert(faces.end(), part.faces(face_size).begin(), part.faces(face_size).end());
+        if (has_normals) {
+            auto& normals = mesh.face_normals(face_size);
+            if (chunk.has_normal_indices) {
+                normals.insert(normals.end(), part.face_normals(face_size).begin(), part.face_normals(face_size).end());
+            }
+            else {
+                normals.resize(faces.size(), -1);
             }
         }
     }
+    chunk = Chunk();
+}
 
-    file.close();
+// drop faces that refer to vertices outside the mesh, and unset normal indices that are outside it
+void remove_invalid_faces(MeshData& mesh, bool has_normals) {
+    size_t n_vertices = mesh.n_vertices();
+    int n_normals = static_cast<int>(mesh.normals.size());
+    for (unsigned int face_size : { 3u, 4u }) {
+        auto& faces = mesh.faces(face_size);
+        auto& normals = mesh.face_normals(face_size);
+        size_t kept = 0;
+        for (size_t start = 0; start < faces.size(); start += face_size) {
+            const unsigned int* face = &faces[start];
+            if (std::any_of(face, face + face_size, [&](unsigned int v) { return v >= n_vertices; })) {
+                continue;
+            }
+            for (size_t i = 0; i < face_size; i++) {
+                faces[kept + i] = face[i];
+                if (has_normals) {
+                    int n = normals[start + i];
+                    normals[kept + i] = n < 0 || n >= n_normals ? -1 : n;
+                }
+            }
+            kept += face_size;
+        }
+        faces.resize(kept);
+        if (has_normals) {
+            normals.resize(kept);
+        }
+    }
+}
 
-    return obj_data;
+// run f(i) for i in [0, n), each on its own thread
+template <typename F>
+void parallel_for(size_t n, F f) {
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < n; i++) {
+        threads.push_back(std::thread(f, i));
+    }
+    f(0);
+    for (auto& t : threads) {
+        t.join();
+    }
+}
+
+} // namespace
+
+MeshData parse_obj(std::string_view text, size_t n_threads) {
+    if (n_threads == 0) {
+        n_threads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    size_t n_chunks = std::clamp<size_t>(text.size() / MIN_CHUNK_SIZE, 1, n_threads);
+
+    // split the text into chunks that each end just after a newline, so no line is split between chunks
+    std::vector<std::string_view> pieces;
+    size_t start = 0;
+    for (size_t i = 1; i <= n_chunks; i++) {
+        size_t end = text.size();
+        if (i < n_chunks) {
+            end = text.find('\n', std::max(start, text.size() * i / n_chunks));
+            end = end == std::string_view::npos ? text.size() : end + 1;
+        }
+        pieces.push_back(text.substr(start, end - start));
+        start = end;
+    }
+
+    std::vector<Chunk> chunks(pieces.size());
+    parallel_for(chunks.size(), [&](size_t i) {
+        parse_chunk(pieces[i], chunks[i]);
+    });
+
+    MeshData mesh;
+    bool has_normals = false;
+    if (chunks.size() == 1) {
+        resolve_relative_indices(chunks[0], 0, 0);
+        has_normals = chunks[0].has_normal_indices;
+        mesh = std::move(chunks[0].mesh);
+    }
+    else {
+        size_t n_vertices = 0;
+        size_t n_normals = 0;
+        size_t n_indices[2] = {};
+        for (const auto& chunk : chunks) {
+            n_vertices += chunk.mesh.n_vertices();
+            n_normals += chunk.mesh.normals.size();
+            n_indices[0] += chunk.mesh.triangles.size();
+            n_indices[1] += chunk.mesh.quads.size();
+            has_normals |= chunk.has_normal_indices;
+        }
+        mesh.vertices.reserve(3 * n_vertices + 1);
+        mesh.normals.reserve(n_normals);
+        mesh.triangles.reserve(n_indices[0]);
+        mesh.quads.reserve(n_indices[1]);
+        if (has_normals) {
+            mesh.triangle_normals.reserve(n_indices[0]);
+            mesh.quad_normals.reserve(n_indices[1]);
+        }
+
+        // merge one chunk at a time, releasing each as soon as it's copied,
+        // so that no more than one chunk is ever held twice
+        size_t vertex_offset = 0;
+        size_t normal_offset = 0;
+        for (auto& chunk : chunks) {
+            resolve_relative_indices(chunk, vertex_offset, normal_offset);
+            vertex_offset += chunk.mesh.n_vertices();
+            normal_offset += chunk.mesh.normals.size();
+            append_chunk(mesh, chunk, has_normals);
+        }
+    }
+
+    remove_invalid_faces(mesh, has_normals);
+    if (!has_normals || mesh.normals.empty()) {
+        mesh.normals = {};
+        mesh.triangle_normals = {};
+        mesh.quad_normals = {};
+    }
+    mesh.vertices.push_back(0.0f);
+    return mesh;
+}
+
+std::optional<MeshData> load_obj(const std::string& filename) {
+    std::cerr << "Loading " << filename << "..." <<std::endl;
+    auto file = MappedFile::open(filename);
+    if (!file) {
+        std::cout << "Unable to open file " << filename << std::endl;
+        return std::nullopt;
+    }
+    return parse_obj(file->view());
 }
 
-} // namespace obj
\ No newline at end of file
+} // namespace obj
@@ -1,45 +1,62 @@
 #pragma once
 
 #include <array>
+#include <cstddef>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace obj {
 
-struct Vertex {
-    float x;
-    float y;
-    float z;
-    float w = 1.0;
-
-    static std::optional<Vertex> from_line(const std::string& line);
+// a mesh from an .obj file, laid out the way embree reads it so that its buffers can be shared rather than copied
+// embree needs triangles and quads in separate geometries, so they're kept apart here
+// larger polygons are split into a fan of quads (and possibly a final triangle)
+struct MeshData {
+    // x, y and z of each vertex, followed by one float of padding, since embree reads vertices 16 bytes at a time
+    std::vector<float> vertices;
+    // 3 0-based vertex indices per triangle, and 4 per quad
+    std::vector<unsigned int> triangles;
+    std::vector<unsigned int> quads;
+    // vertex normals, and 0-based indices into them for each corner of each face (-1 for a corner without a normal)
+    // these are all empty if the file has no normals, or no face refers to them
+    std::vector<std::array<float, 3>> normals;
+    std::vector<int> triangle_normals;
+    std::vector<int> quad_normals;
+
+    size_t n_vertices() const {
+        return vertices.size() / 3;
+    }
+    // the triangles (face_size 3) or the quads (face_size 4)
+    std::vector<unsigned int>& faces(unsigned int face_size) {
+        return face_size == 3 ? triangles : quads;
+    }
+    const std::vector<unsigned int>& faces(unsigned int face_size) const {
+        return face_size == 3 ? triangles : quads;
+    }
+    std::vector<int>& face_normals(unsigned int face_size) {
+        return face_size == 3 ? triangle_normals : quad_normals;
+    }
+    const std::vector<int>& face_normals(unsigned int face_size) const {
+        return face_size == 3 ? triangle_normals : quad_normals;
+    }
+    size_t n_faces(unsigned int face_size) const {
+        return faces(face_size).size() / face_size;
+    }
+    size_t n_faces() const {
+        return n_faces(3) + n_faces(4);
+    }
+    // whether the faces have normal indices; a file can have normals that no face refers to
+    bool has_normals() const {
+        return !normals.empty() && (!triangle_normals.empty() || !quad_normals.empty());
+    }
 };
 
-struct VertexNormal {
-    float x;
-    float y;
-    float z;
-
-    static std::optional<VertexNormal> from_line(const std::string& line);
-};
-
-struct FaceElement {
-    std::array<int, 4> vertices;
-    std::array<int, 4> textures;
-    std::array<int, 4> normals;
-
-    size_t n_vertices;
-
-    static std::optional<FaceElement> from_line(const std::string& line);
-};
-
-struct ObjData {
-    std::vector<Vertex> vertices;
-    std::vector<VertexNormal> vertex_normals;
-    std::vector<FaceElement> faces;
-};
+// parse the contents of an .obj file
+// relative indices are resolved, and faces that refer to vertices outside the file are dropped
+// large files are split into chunks that are parsed on up to n_threads threads (0 to use every core)
+MeshData parse_obj(std::string_view text, size_t n_threads = 0);
 
-std::optional<ObjData> load_obj(const std::string& filename);
+std::optional<MeshData> load_obj(const std::string& filename);
 
 } // namespace obj
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <iostream>
+#include <mutex>
+
+// a progress bar printed to stdout; safe to increment from multiple threads
+struct ProgressBar {
+    size_t total;
+    std::atomic<size_t> current = 0;
+    size_t width = 40;
+    std::mutex mutex;
+    
+    void display(size_t count) {
+        std::cout << "[";
+        size_t pos = width * count / total;
+        for (size_t i = 0; i < width; i++) {
+            if (i < pos) {
+                std::cout << "=";
+            }
+            else if (i == pos) {
+                std::cout << ">";
+            }
+            else {
+                std::cout << " ";
+            }
+        }
+        std::cout << "] " << int(100.0 * count / total) << "%\r";
+        std::cout.flush();
+    }
+
+    void increment(size_t n = 1, bool display = true) {
+        size_t prev = current.fetch_add(n);
+        // only redraw (and take the lock) when the displayed percentage actually changes
+        if (display && 100 * prev / total != 100 * (prev + n) / total) {
+            std::lock_guard<std::mutex> lock(mutex);
+            this->display(current.load());
+        }
+    }
+};
\ No newline at end of file
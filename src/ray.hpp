@@ -15,3 +15,10 @@ public:
     Pt3 o;
     Vec3 d;
 };
+
+// rays through the points one pixel over in x and in y from a camera ray's pixel
+// where a ray hits a surface, they show how much of the surface its pixel covers
+struct RayDifferentials {
+    Ray rx;
+    Ray ry;
+};
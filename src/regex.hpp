@@ -1,9 +0,0 @@
-#pragma once
-
-#ifdef NO_BOOST
-#include <regex>
-namespace regex = std;
-#else
-#include <boost/regex.hpp>
-namespace regex = boost;
-#endif
\ No newline at end of file
@@ -5,9 +5,44 @@
 #include "image.hpp"
 #include "vec.hpp"
 
+// side length, in pixels, of the square tiles that work is divided into
+const size_t DEFAULT_TILE_SIZE = 16;
+
+// settings for adaptive sampling
+// every pixel gets min_samples in the first pass; after that, pixels whose estimated relative error
+// is still above error_threshold get another pass_samples samples per pass, up to max_samples in total
+struct AdaptiveSampling {
+    size_t min_samples;
+    size_t max_samples;
+    float error_threshold = 0.01f;
+    size_t pass_samples = 8;
+};
+
+// render with a fixed number of samples for every pixel
+RenderResult render(
+    const Camera& camera,
+    const Scene& world,
+    size_t n_samples,
+    size_t max_bounces,
+    size_t tile_size = DEFAULT_TILE_SIZE
+);
+
+// render with a per-pixel sample count that adapts to the noise in each pixel
 RenderResult render(
+    const Camera& camera,
+    const Scene& world,
+    const AdaptiveSampling& sampling,
+    size_t max_bounces,
+    size_t tile_size = DEFAULT_TILE_SIZE
+);
+
+// render with a wavefront (breadth-first) integrator
+// rather than tracing each path to completion, paths for a whole tile are advanced one bounce at a time,
+// which lets rays be traced in packets and shading be grouped by material
+RenderResult render_wavefront(
     const Camera& camera,
     const Scene& world,
     size_t n_samples,
-    size_t max_bounces
+    size_t max_bounces,
+    size_t tile_size = DEFAULT_TILE_SIZE
 );
\ No newline at end of file
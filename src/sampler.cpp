@@ -90,53 +90,6 @@ uint32_t round_up_pow2(uint32_t x) {
 }
 
 
-uint64_t MurmurHash64A(const unsigned char *key, size_t len,
-                                           uint64_t seed) {
-    const uint64_t m = 0xc6a4a7935bd1e995ull;
-    const int r = 47;
-
-    uint64_t h = seed ^ (len * m);
-
-    const unsigned char *end = key + 8 * (len / 8);
-
-    while (key != end) {
-        uint64_t k;
-        memcpy(&k, key, sizeof(uint64_t));
-        key += 8;
-
-        k *= m;
-        k ^= k >> r;
-        k *= m;
-
-        h ^= k;
-        h *= m;
-    }
-
-    switch (len & 7) {
-    case 7:
-        h ^= uint64_t(key[6]) << 48;
-    case 6:
-        h ^= uint64_t(key[5]) << 40;
-    case 5:
-        h ^= uint64_t(key[4]) << 32;
-    case 4:
-        h ^= uint64_t(key[3]) << 24;
-    case 3:
-        h ^= uint64_t(key[2]) << 16;
-    case 2:
-        h ^= uint64_t(key[1]) << 8;
-    case 1:
-        h ^= uint64_t(key[0]);
-        h *= m;
-    };
-
-    h ^= h >> r;
-    h *= m;
-    h ^= h >> r;
-
-    return h;
-}
-
 template <typename... Args>
 void hash_recursive_copy(char *buf, Args...);
 
@@ -155,7 +108,7 @@ uint64_t hash(Args... args) {
     constexpr size_t n = (sz + 7) / 8;
     uint64_t buf[n];
     hash_recursive_copy(reinterpret_cast<char *>(buf), args...);
-    return MurmurHash64A(reinterpret_cast<const unsigned char *>(buf), sz, 0);
+    return hash_bytes(buf, sz, 0);
 }
 
 int permutation_element(uint32_t i, uint32_t l, uint32_t p) {
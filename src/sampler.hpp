@@ -18,6 +18,13 @@ private:
 };
 
 
+// position of a Sampler within its sequence
+// small enough to store per path, so that many paths in flight can share one sampler's tables
+struct SamplerState {
+    int64_t halton_index;
+    int dimension;
+};
+
 // a Halton sampler, for deterministically generating 1d and 2d values
 class Sampler {
 public:
@@ -32,6 +39,14 @@ public:
         start_pixel_sample(x, y, sample_index, 0);
     }
 
+    SamplerState state() const {
+        return { halton_index, dimension };
+    }
+    void set_state(const SamplerState& state) {
+        halton_index = state.halton_index;
+        dimension = state.dimension;
+    }
+
     int samples_per_pixel() const {
         return m_samples_per_pixel;
     }
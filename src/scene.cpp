@@ -1,8 +1,16 @@
+#include <algorithm>
+#include <filesystem>
 #include <fstream>
+#include <iomanip>
+#include <set>
+#include <sstream>
 #include <vector>
 
+#include <unistd.h>
+
 #include "obj/obj.hpp"
 #include "scene.hpp"
+#include "util.hpp"
 
 void error_function(void* userPtr, enum RTCError error, const char* str)
 {
@@ -20,10 +28,171 @@ RTCDevice initialize_device() {
 }
 
 void Scene::commit() {
+    commit_primitive_batches();
+    build_geometry_table();
+    bake_spectra();
+    // built after baking, so that it measures the lights' power with the spectra they'll render with
+    m_light_sampler = make_light_sampler(m_light_sampling, m_lights);
     rtcCommitScene(m_scene);
     m_ready = true;
 }
 
+PrimitiveBatch& Scene::primitive_batch(ShapeType shape, Material* material) {
+    auto [it, inserted] = m_batch_index.insert({ { shape, material }, m_batches.size() });
+    if (inserted) {
+        m_batches.push_back({ .shape = shape, .material = material });
+    }
+    return m_batches[it->second];
+}
+
+void Scene::commit_primitive_batches() {
+    for (auto& batch : m_batches) {
+        size_t n = batch.size();
+        RTCGeometry geom;
+        // embree's copies of the batch's buffers, which live as long as the geometry
+        const float* batch_vertices = nullptr;
+        const unsigned int* batch_faces = nullptr;
+        if (batch.shape == ShapeType::SPHERE) {
+            geom = rtcNewGeometry(m_device, RTC_GEOMETRY_TYPE_SPHERE_POINT);
+            float* vertices = static_cast<float*>(rtcSetNewGeometryBuffer(
+                geom,
+                RTC_BUFFER_TYPE_VERTEX,
+                0,
+                RTC_FORMAT_FLOAT4,
+                4 * sizeof(float),
+                n
+            ));
+            if (!vertices) {
+                std::cerr << "Something went wrong when making spheres" << std::endl;
+                rtcReleaseGeometry(geom);
+                continue;
+            }
+            std::copy(batch.vertices.begin(), batch.vertices.end(), vertices);
+            batch_vertices = vertices;
+        }
+        else {
+            // each triangle or quad gets its own vertices, so the index buffer just counts up
+            bool is_quad = batch.shape == ShapeType::QUAD;
+            unsigned int n_verts = is_quad ? 4 : 3;
+            geom = rtcNewGeometry(m_device, is_quad ? RTC_GEOMETRY_TYPE_QUAD : RTC_GEOMETRY_TYPE_TRIANGLE);
+            float* vertices = static_cast<float*>(rtcSetNewGeometryBuffer(
+                geom,
+                RTC_BUFFER_TYPE_VERTEX,
+                0,
+                RTC_FORMAT_FLOAT3,
+                3 * sizeof(float),
+                n * n_verts
+            ));
+            unsigned int* indices = static_cast<unsigned int*>(rtcSetNewGeometryBuffer(
+                geom,
+                RTC_BUFFER_TYPE_INDEX,
+                0,
+                is_quad ? RTC_FORMAT_UINT4 : RTC_FORMAT_UINT3,
+                n_verts * sizeof(unsigned int),
+                n
+            ));
+            if (!vertices || !indices) {
+                std::cerr << "Something went wrong when making " << (is_quad ? "quads" : "triangles") << std::endl;
+                rtcReleaseGeometry(geom);
+                continue;
+            }
+            std::copy(batch.vertices.begin(), batch.vertices.end(), vertices);
+            for (unsigned int i = 0; i < n * n_verts; i++) {
+                indices[i] = i;
+            }
+            batch_vertices = vertices;
+            batch_faces = indices;
+        }
+
+        // only keep the per-primitive lights if there are any
+        bool has_lights = std::any_of(batch.lights.begin(), batch.lights.end(), [](const AreaLight* light) {
+            return light != nullptr;
+        });
+        m_geom_data.push_back({
+            .shape = batch.shape,
+            .material = batch.material,
+            .lights = has_lights ? std::move(batch.lights) : std::vector<const AreaLight*>(),
+            .face_size = batch.shape == ShapeType::TRIANGLE ? 3u : 4u,
+            .vertices = batch_vertices,
+            .faces = batch_faces
+        });
+
+        rtcCommitGeometry(geom);
+        m_geom_data.back().geom_id = rtcAttachGeometry(m_scene, geom);
+        rtcReleaseGeometry(geom);
+    }
+    m_batches.clear();
+    m_batch_index.clear();
+}
+
+ShapeRecord shape_record(const GeometryData& data) {
+    return ShapeRecord {
+        .normals = data.normals,
+        .normal_indices = data.normal_indices,
+        .vertices = data.vertices,
+        .faces = data.faces,
+        .shape = data.shape,
+        .face_size = data.face_size
+    };
+}
+
+void Scene::build_geometry_table() {
+    GeometryTable& table = m_geometry_table;
+    table = GeometryTable();
+
+    // each mesh's shapes are stored once, however many instances there are of it
+    std::map<const MeshPrototype*, unsigned int> prototype_shapes;
+    for (const auto& mesh : m_prototypes) {
+        unsigned int first = table.shapes.size();
+        prototype_shapes[&mesh] = first;
+        table.shapes.resize(first + mesh.geom_data.size());
+        for (const auto& data : mesh.geom_data) {
+            table.shapes[first + data.geom_id] = shape_record(data);
+        }
+    }
+
+    for (const auto& data : m_geom_data) {
+        if (data.geom_id >= table.geometries.size()) {
+            table.geometries.resize(data.geom_id + 1);
+        }
+        GeometryRecord& record = table.geometries[data.geom_id];
+        record.material = data.material;
+        record.transform = data.transform ? &*data.transform : nullptr;
+        if (data.instanced) {
+            record.shape = prototype_shapes[data.instanced];
+        }
+        else {
+            record.shape = table.shapes.size();
+            table.shapes.push_back(shape_record(data));
+        }
+        record.lights = -1;
+        if (!data.lights.empty()) {
+            record.lights = table.lights.size();
+            table.lights.insert(table.lights.end(), data.lights.begin(), data.lights.end());
+        }
+    }
+}
+
+void Scene::bake_spectra() {
+    std::set<Material*> materials;
+    for (const auto& data : m_geom_data) {
+        materials.insert(data.material);
+    }
+    for (const auto& mesh : m_prototypes) {
+        for (const auto& data : mesh.geom_data) {
+            materials.insert(data.material);
+        }
+    }
+    materials.erase(nullptr);
+    for (Material* material : materials) {
+        material->bake_spectra(m_spectrum_baker);
+    }
+    for (auto& light : m_lights) {
+        light->bake_spectra(m_spectrum_baker);
+    }
+    m_spectrum_baker.bake(m_bg_light.spectrum);
+}
+
 Vec2 get_sphere_uv(const Vec3& n) {
     float phi = std::atan2(n.z, n.x) + M_PI;
     float u = phi / (2.0f * M_PI);
@@ -38,6 +207,41 @@ Vec2 get_sphere_uv(const Vec3& n) {
     return Vec2(u, v);
 }
 
+// how a point on a shape moves with its uv coordinates (given by get_sphere_uv for spheres, and by embree otherwise)
+// these are zero for shapes without vertex buffers to read
+std::pair<Vec3, Vec3> uv_derivatives(const ShapeRecord& shape, unsigned int prim_id, const Vec2& uv, const Vec3& normal) {
+    if (!shape.vertices) {
+        return { Vec3(), Vec3() };
+    }
+    if (shape.shape == ShapeType::SPHERE) {
+        float radius = shape.vertices[4 * prim_id + 3];
+        float sin_theta = std::sqrt(normal.x * normal.x + normal.z * normal.z);
+        Vec3 dpdu = Vec3(-normal.z, 0.0f, normal.x) * (2.0f * M_PI * radius);
+        // v has no single direction at the poles
+        Vec3 dpdv = sin_theta > 0.0f
+            ? Vec3(normal.y * normal.x / sin_theta, -sin_theta, normal.y * normal.z / sin_theta) * (M_PI * radius)
+            : Vec3();
+        return { dpdu, dpdv };
+    }
+    const unsigned int* face = shape.faces + shape.face_size * prim_id;
+    auto vertex = [&](size_t i) {
+        const float* v = shape.vertices + 3 * face[i];
+        return Vec3(v[0], v[1], v[2]);
+    };
+    Vec3 p0 = vertex(0);
+    Vec3 p1 = vertex(1);
+    Vec3 p2 = vertex(2);
+    if (shape.face_size == 3) {
+        return { p1 - p0, p2 - p0 };
+    }
+    // quads are interpolated bilinearly, as their normals are
+    Vec3 p3 = vertex(3);
+    return {
+        (p1 - p0) * (1.0f - uv.y) + (p2 - p3) * uv.y,
+        (p3 - p0) * (1.0f - uv.x) + (p2 - p1) * uv.x
+    };
+}
+
 RTCRayHit create_rayhit(const Ray& ray, RTCScene scene) {
     alignas(16) RTCRayHit rayhit;
     rayhit.ray.org_x = ray.o.x;
@@ -69,178 +273,261 @@ std::optional<SurfaceInteraction> Scene::ray_intersect(
         return std::nullopt;
     }
 
-    auto geom_data = get_geom_data(rayhit.hit.geomID);
-    if (!geom_data) {
-        std::cout << "Geometry data not found for intersected object" << std::endl;
-        return std::nullopt;
+    return surface_interaction(ray, HitRecord {
+        .t = rayhit.ray.tfar,
+        .ng = Vec3(rayhit.hit.Ng_x, rayhit.hit.Ng_y, rayhit.hit.Ng_z),
+        .uv = Vec2(rayhit.hit.u, rayhit.hit.v),
+        .geom_id = rayhit.hit.geomID,
+        .prim_id = rayhit.hit.primID,
+        .inst_id = rayhit.hit.instID[0]
+    });
+}
+
+// number of rays in the packets used for batched queries
+const size_t PACKET_SIZE = 16;
+
+void Scene::ray_intersect(
+    const std::vector<Ray>& rays,
+    std::vector<std::optional<SurfaceInteraction>>& interactions,
+    bool coherent
+) const {
+    interactions.resize(rays.size());
+    // lets embree trace the packet together through the bvh rather than splitting it up
+    RTCIntersectArguments args;
+    rtcInitIntersectArguments(&args);
+    args.flags = coherent ? RTC_RAY_QUERY_FLAG_COHERENT : RTC_RAY_QUERY_FLAG_INCOHERENT;
+    for (size_t start = 0; start < rays.size(); start += PACKET_SIZE) {
+        size_t n = std::min(PACKET_SIZE, rays.size() - start);
+        alignas(64) int valid[PACKET_SIZE];
+        alignas(64) RTCRayHit16 rayhit;
+        for (size_t i = 0; i < PACKET_SIZE; i++) {
+            valid[i] = i < n ? -1 : 0;
+            if (i >= n) {
+                continue;
+            }
+            const Ray& ray = rays[start + i];
+            rayhit.ray.org_x[i] = ray.o.x;
+            rayhit.ray.org_y[i] = ray.o.y;
+            rayhit.ray.org_z[i] = ray.o.z;
+            rayhit.ray.dir_x[i] = ray.d.x;
+            rayhit.ray.dir_y[i] = ray.d.y;
+            rayhit.ray.dir_z[i] = ray.d.z;
+            rayhit.ray.tnear[i] = 0.0001f;
+            rayhit.ray.tfar[i] = std::numeric_limits<float>::infinity();
+            rayhit.ray.time[i] = 0.0f;
+            rayhit.ray.mask[i] = -1;
+            rayhit.ray.id[i] = i;
+            rayhit.ray.flags[i] = 0;
+            rayhit.hit.geomID[i] = RTC_INVALID_GEOMETRY_ID;
+            rayhit.hit.instID[0][i] = RTC_INVALID_GEOMETRY_ID;
+        }
+
+        rtcIntersect16(valid, m_scene, &rayhit, &args);
+
+        for (size_t i = 0; i < n; i++) {
+            if (rayhit.hit.geomID[i] == RTC_INVALID_GEOMETRY_ID) {
+                interactions[start + i] = std::nullopt;
+                continue;
+            }
+            interactions[start + i] = surface_interaction(rays[start + i], HitRecord {
+                .t = rayhit.ray.tfar[i],
+                .ng = Vec3(rayhit.hit.Ng_x[i], rayhit.hit.Ng_y[i], rayhit.hit.Ng_z[i]),
+                .uv = Vec2(rayhit.hit.u[i], rayhit.hit.v[i]),
+                .geom_id = rayhit.hit.geomID[i],
+                .prim_id = rayhit.hit.primID[i],
+                .inst_id = rayhit.hit.instID[0][i]
+            });
+        }
     }
+}
+
+std::optional<SurfaceInteraction> Scene::surface_interaction(const Ray& ray, const HitRecord& hit) const {
+    // the table covers every attached geometry, so there's nothing to check here
+    bool is_instance = hit.inst_id != RTC_INVALID_GEOMETRY_ID;
+    const GeometryRecord& geometry = m_geometry_table.geometries[is_instance ? hit.inst_id : hit.geom_id];
+    // an instance has its own material, but its shape and normals come from the mesh it places
+    // embree reports the ID of the geometry that was hit within the instanced scene
+    const ShapeRecord& shape = m_geometry_table.shapes[geometry.shape + (is_instance ? hit.geom_id : 0)];
 
-    auto shape = geom_data->shape;
-    auto material = geom_data->material;
-    auto light = geom_data->light;
-    auto normal_data = geom_data->normals.get();
-    Vec2 uv(rayhit.hit.u, rayhit.hit.v);
+    auto material = geometry.material;
+    auto light = geometry.lights < 0 ? nullptr : m_geometry_table.lights[geometry.lights + hit.prim_id];
+    Vec2 uv = hit.uv;
 
     Vec3 normal;
-    if (normal_data && shape == ShapeType::OBJ) {
-        auto face_indices = normal_data->faces[rayhit.hit.primID];
-        Vec3 v0 = normal_data->normals[face_indices[0]];
-        Vec3 v1 = normal_data->normals[face_indices[1]];
-        Vec3 v2 = normal_data->normals[face_indices[2]];
-        Vec3 v3 = normal_data->normals[face_indices[3]];
-        // use uv coordinates to interpolate over vertex normals
-        normal = (
-            (1.0f - uv.x) * (1.0f - uv.y) * v0
-            + uv.x * (1.0f - uv.y) * v1
-            + uv.x * uv.y * v2
-            + (1.0f - uv.x) * uv.y * v3
-        ).normalized();
+    const int* normal_indices = nullptr;
+    if (shape.normal_indices) {
+        normal_indices = shape.normal_indices + shape.face_size * hit.prim_id;
+    }
+    // every corner needs a normal to interpolate
+    if (normal_indices && std::all_of(normal_indices, normal_indices + shape.face_size, [](int i) { return i >= 0; })) {
+        auto vertex_normal = [&](size_t i) {
+            const auto& n = shape.normals[normal_indices[i]];
+            return Vec3(n[0], n[1], n[2]);
+        };
+        Vec3 v0 = vertex_normal(0);
+        Vec3 v1 = vertex_normal(1);
+        Vec3 v2 = vertex_normal(2);
+        if (shape.face_size == 3) {
+            // for triangles, embree's uv are barycentric coordinates
+            normal = ((1.0f - uv.x - uv.y) * v0 + uv.x * v1 + uv.y * v2).normalized();
+        }
+        else {
+            Vec3 v3 = vertex_normal(3);
+            // use uv coordinates to interpolate over vertex normals
+            normal = (
+                (1.0f - uv.x) * (1.0f - uv.y) * v0
+                + uv.x * (1.0f - uv.y) * v1
+                + uv.x * uv.y * v2
+                + (1.0f - uv.x) * uv.y * v3
+            ).normalized();
+        }
     }
     else {
-        normal = Vec3(rayhit.hit.Ng_x, rayhit.hit.Ng_y, rayhit.hit.Ng_z).normalized();
+        normal = hit.ng.normalized();
+    }
+    auto [dpdu, dpdv] = uv_derivatives(shape, hit.prim_id, uv, normal);
+    if (geometry.transform) {
+        // embree gives instance hits in the mesh's object space
+        normal = geometry.transform->apply_normal(normal).normalized();
+        dpdu = geometry.transform->apply(dpdu);
+        dpdv = geometry.transform->apply(dpdv);
     }
 
-    if (shape == ShapeType::SPHERE) {
+    if (shape.shape == ShapeType::SPHERE) {
         // embree doesn't have uv coordinates for spheres
         // need to calculate this manually
         uv = get_sphere_uv(normal);
     }
 
-    return SurfaceInteraction(
-        ray.at(rayhit.ray.tfar),
+    SurfaceInteraction si(
+        ray.at(hit.t),
         (-ray.d).normalized(),
         normal,
         uv,
         material,
         light
     );
+    si.dpdu = dpdu;
+    si.dpdv = dpdv;
+    return si;
 }
 
 std::pair<const Light*, float> Scene::sample_lights(
     const Pt3& point, const Vec3& normal,
     Sampler& sampler
 ) const {
-    if (m_lights.empty()) {
+    // there's no light sampler until the scene is committed
+    if (m_lights.empty() || !m_light_sampler) {
         return {nullptr, 0.0f};
     }
     // randomly select a light to sample from
     float u = sampler.sample_1d();
-    size_t i = static_cast<size_t>(u * m_lights.size());
-    return {m_lights[i].get(), 1.0f / m_lights.size()};
+    return m_light_sampler->sample(point, normal, u);
 }
 
 float Scene::light_sample_pmf(const Pt3& point, const Vec3& normal, const Light* light) const {
-    return 1.0f / m_lights.size();
+    if (!m_light_sampler) {
+        return 0.0f;
+    }
+    return m_light_sampler->pmf(point, normal, light);
 }
 
-bool Scene::occluded(Pt3 start, Pt3 end) const {
-    Ray ray(start, end - start);
-    auto rayhit = create_rayhit(ray, m_scene);
-    if (rayhit.hit.geomID == RTC_INVALID_GEOMETRY_ID) {
-        return false;
+void Scene::set_light_sampling(LightSampling sampling) {
+    m_light_sampling = sampling;
+    if (m_light_sampler) {
+        m_light_sampler = make_light_sampler(sampling, m_lights);
     }
-    return rayhit.ray.tfar <= 1.0f;
 }
 
-GeometryData* Scene::add_triangle(const Pt3& a, const Pt3& b, const Pt3& c, const Material* material) {
-    RTCGeometry geom = rtcNewGeometry(
-        m_device,
-        RTC_GEOMETRY_TYPE_TRIANGLE
-    );
-    float* vertices = static_cast<float*>(rtcSetNewGeometryBuffer(
-        geom,
-        RTC_BUFFER_TYPE_VERTEX,
-        0,
-        RTC_FORMAT_FLOAT3,
-        3 * sizeof(float),
-        3
-    ));
-    unsigned int* indices = static_cast<unsigned int*>(rtcSetNewGeometryBuffer(
-        geom,
-        RTC_BUFFER_TYPE_INDEX,
-        0,
-        RTC_FORMAT_UINT3,
-        3 * sizeof(unsigned int),
-        1
-    ));
-    
-    if (vertices && indices) {
-        vertices[0] = a.x; vertices[1] = a.y; vertices[2] = a.z;
-        vertices[3] = b.x; vertices[4] = b.y; vertices[5] = b.z;
-        vertices[6] = c.x; vertices[7] = c.y; vertices[8] = c.z;
+bool Scene::occluded(Pt3 start, Pt3 end) const {
+    Vec3 d = end - start;
+    alignas(16) RTCRay ray;
+    ray.org_x = start.x;
+    ray.org_y = start.y;
+    ray.org_z = start.z;
+    ray.dir_x = d.x;
+    ray.dir_y = d.y;
+    ray.dir_z = d.z;
+    ray.tnear = 0.0001f;
+    // direction isn't normalized, so the end point is at t = 1
+    ray.tfar = 1.0f;
+    ray.time = 0.0f;
+    ray.mask = -1;
+    ray.id = 0;
+    ray.flags = 0;
+
+    // any hit will do, so embree can stop traversal at the first one it finds
+    rtcOccluded1(m_scene, &ray);
+
+    // embree sets tfar to -inf for rays that hit something
+    return ray.tfar < 0.0f;
+}
 
-        indices[0] = 0;
-        indices[1] = 1;
-        indices[2] = 2;
-    }
-    else {
-        std::cerr << "Something went wrong when making triangle" << std::endl;
-    }
-    m_geom_data.push_back({ ShapeType::TRIANGLE, material });
-    GeometryData* geom_data = &m_geom_data.back();
-    rtcSetGeometryUserData(geom, geom_data);
+void Scene::occluded(const std::vector<std::pair<Pt3, Pt3>>& segments, std::vector<char>& result) const {
+    result.resize(segments.size());
+    for (size_t start = 0; start < segments.size(); start += PACKET_SIZE) {
+        size_t n = std::min(PACKET_SIZE, segments.size() - start);
+        alignas(64) int valid[PACKET_SIZE];
+        alignas(64) RTCRay16 ray;
+        for (size_t i = 0; i < PACKET_SIZE; i++) {
+            valid[i] = i < n ? -1 : 0;
+            if (i >= n) {
+                continue;
+            }
+            const auto& [p0, p1] = segments[start + i];
+            Vec3 d = p1 - p0;
+            ray.org_x[i] = p0.x;
+            ray.org_y[i] = p0.y;
+            ray.org_z[i] = p0.z;
+            ray.dir_x[i] = d.x;
+            ray.dir_y[i] = d.y;
+            ray.dir_z[i] = d.z;
+            ray.tnear[i] = 0.0001f;
+            // direction isn't normalized, so the end point is at t = 1
+            ray.tfar[i] = 1.0f;
+            ray.time[i] = 0.0f;
+            ray.mask[i] = -1;
+            ray.id[i] = i;
+            ray.flags[i] = 0;
+        }
 
-    rtcCommitGeometry(geom);
-    rtcAttachGeometry(m_scene, geom);
-    rtcReleaseGeometry(geom);
+        rtcOccluded16(valid, m_scene, &ray);
 
-    return geom_data;
+        // embree sets tfar to -inf for rays that hit something
+        for (size_t i = 0; i < n; i++) {
+            result[start + i] = ray.tfar[i] < 0.0f;
+        }
+    }
+}
+
+void Scene::add_triangle(const Pt3& a, const Pt3& b, const Pt3& c, Material* material) {
+    auto& batch = primitive_batch(ShapeType::TRIANGLE, material);
+    batch.vertices.insert(batch.vertices.end(), {
+        a.x, a.y, a.z,
+        b.x, b.y, b.z,
+        c.x, c.y, c.z
+    });
+    batch.lights.push_back(nullptr);
 }
 
-GeometryData* Scene::add_quad(
+void Scene::add_quad(
     const Pt3& a,
     const Pt3& b,
     const Pt3& c,
     const Pt3& d,
-    const Material* material
+    Material* material
 ) {
-    RTCGeometry geom = rtcNewGeometry(
-        m_device,
-        RTC_GEOMETRY_TYPE_QUAD
-    );
-    float* vertices = static_cast<float*>(rtcSetNewGeometryBuffer(
-        geom,
-        RTC_BUFFER_TYPE_VERTEX,
-        0,
-        RTC_FORMAT_FLOAT3,
-        3 * sizeof(float),
-        4
-    ));
-    unsigned int* indices = static_cast<unsigned int*>(rtcSetNewGeometryBuffer(
-        geom,
-        RTC_BUFFER_TYPE_INDEX,
-        0,
-        RTC_FORMAT_UINT4,
-        4 * sizeof(unsigned int),
-        1
-    ));
-    
-    if (vertices && indices) {
-        vertices[0] = a.x; vertices[1] = a.y; vertices[2] = a.z;
-        vertices[3] = b.x; vertices[4] = b.y; vertices[5] = b.z;
-        vertices[6] = c.x; vertices[7] = c.y; vertices[8] = c.z;
-        vertices[9] = d.x; vertices[10] = d.y; vertices[11] = d.z;
-
-        indices[0] = 0;
-        indices[1] = 1;
-        indices[2] = 2;
-        indices[3] = 3;
-    }
-    else {
-        std::cerr << "Something went wrong when making quad" << std::endl;
-    }
-    m_geom_data.push_back({ ShapeType::QUAD, material });
-    GeometryData* geom_data = &m_geom_data.back();
-    rtcSetGeometryUserData(geom, geom_data);
-
-    rtcCommitGeometry(geom);
-    rtcAttachGeometry(m_scene, geom);
-    rtcReleaseGeometry(geom);
-
-    return geom_data;
+    auto& batch = primitive_batch(ShapeType::QUAD, material);
+    batch.vertices.insert(batch.vertices.end(), {
+        a.x, a.y, a.z,
+        b.x, b.y, b.z,
+        c.x, c.y, c.z,
+        d.x, d.y, d.z
+    });
+    batch.lights.push_back(nullptr);
 }
 
-GeometryData* Scene::add_plane(const Pt3& p, const Vec3& n, const Material* material, float half_size) {
+void Scene::add_plane(const Pt3& p, const Vec3& n, Material* material, float half_size) {
     // plane will be modeled as a large quad centered around the given point
     
     OrthonormalBasis basis(n);
@@ -249,130 +536,273 @@ GeometryData* Scene::add_plane(const Pt3& p, const Vec3& n, const Material* mate
     Pt3 c = p + basis.u[0] * half_size + basis.u[1] * half_size;
     Pt3 d = p - basis.u[0] * half_size + basis.u[1] * half_size;
     
-    return add_quad(a, b, c, d, material); 
+    add_quad(a, b, c, d, material); 
 }
 
-GeometryData* Scene::add_sphere(const Pt3& center, float radius, const Material* material) {
-    RTCGeometry geom = rtcNewGeometry(
-        m_device,
-        RTC_GEOMETRY_TYPE_SPHERE_POINT
-    );
-    float* vertices = static_cast<float*>(rtcSetNewGeometryBuffer(
-        geom,
-        RTC_BUFFER_TYPE_VERTEX,
-        0,
-        RTC_FORMAT_FLOAT4,
-        4 * sizeof(float),
-        1
-    ));
+void Scene::add_sphere(const Pt3& center, float radius, Material* material) {
+    auto& batch = primitive_batch(ShapeType::SPHERE, material);
+    batch.vertices.insert(batch.vertices.end(), { center.x, center.y, center.z, radius });
+    batch.lights.push_back(nullptr);
+}
 
-    if (vertices) {
-        vertices[0] = center.x;
-        vertices[1] = center.y;
-        vertices[2] = center.z;
-        vertices[3] = radius;
+// move a mesh's vertices and normals by the given transform
+void transform_mesh(obj::MeshData& mesh, const Transform& transform) {
+    // the last float of the vertex buffer is padding
+    for (size_t i = 0; i + 3 < mesh.vertices.size(); i += 3) {
+        Pt3 p = transform * Pt3(mesh.vertices[i], mesh.vertices[i + 1], mesh.vertices[i + 2]);
+        mesh.vertices[i] = p.x;
+        mesh.vertices[i + 1] = p.y;
+        mesh.vertices[i + 2] = p.z;
     }
-    else {
-        std::cerr << "Something went wrong when making sphere" << std::endl;
+    for (auto& n : mesh.normals) {
+        Vec3 v = transform.apply_normal(Vec3(n[0], n[1], n[2]));
+        n = { v.x, v.y, v.z };
     }
-    m_geom_data.push_back({ ShapeType::SPHERE, material });
-    GeometryData* geom_data = &m_geom_data.back();
-    rtcSetGeometryUserData(geom, geom_data);
+}
 
-    rtcCommitGeometry(geom);
-    rtcAttachGeometry(m_scene, geom);
-    rtcReleaseGeometry(geom);
+// the buffers of a mesh's triangles (face_size 3) or quads (face_size 4), from either a parsed .obj file
+// or a mapped mesh file; embree reads them in place, so they have to outlive its geometry
+struct MeshBuffers {
+    const float* vertices;
+    size_t n_vertices;
+    const unsigned int* faces;
+    size_t n_faces;
+    unsigned int face_size;
+    // nullptr if the mesh has no normals
+    const std::array<float, 3>* normals;
+    const int* face_normals;
+};
+
+MeshBuffers mesh_buffers(const obj::MeshData& mesh, unsigned int face_size) {
+    bool has_normals = mesh.has_normals();
+    return MeshBuffers {
+        .vertices = mesh.vertices.data(),
+        .n_vertices = mesh.n_vertices(),
+        .faces = mesh.faces(face_size).data(),
+        .n_faces = mesh.n_faces(face_size),
+        .face_size = face_size,
+        .normals = has_normals ? mesh.normals.data() : nullptr,
+        .face_normals = has_normals ? mesh.face_normals(face_size).data() : nullptr
+    };
+}
 
-    return geom_data;
+MeshBuffers mesh_buffers(const MeshFile& mesh_file, unsigned int face_size) {
+    return MeshBuffers {
+        .vertices = mesh_file.vertices(),
+        .n_vertices = mesh_file.header().n_vertices,
+        .faces = mesh_file.faces(face_size),
+        .n_faces = mesh_file.n_faces(face_size),
+        .face_size = face_size,
+        .normals = mesh_file.normals(),
+        .face_normals = mesh_file.face_normals(face_size)
+    };
 }
 
-GeometryData* Scene::add_obj(const std::string& filename, const Material* material, const Transform& transform) {
-    auto obj_data = obj::load_obj(filename);
-    if (!obj_data) {
+// attach a geometry for each of a mesh's triangles and quads to scene, and add their data to geom_data
+// returns the data of the first geometry, or nullptr if the mesh has no faces
+template <typename Mesh>
+GeometryData* attach_mesh(
+    RTCDevice device,
+    RTCScene scene,
+    const Mesh& mesh,
+    Material* material,
+    std::deque<GeometryData>& geom_data
+) {
+    GeometryData* first = nullptr;
+    // embree's triangle intersector is faster than its quad one, and triangles need fewer indices,
+    // so triangles aren't stored as quads with a repeated vertex
+    for (unsigned int face_size : { 3u, 4u }) {
+        MeshBuffers buffers = mesh_buffers(mesh, face_size);
+        if (buffers.n_faces == 0) {
+            continue;
+        }
+        RTCGeometry geom = rtcNewGeometry(device, face_size == 3 ? RTC_GEOMETRY_TYPE_TRIANGLE : RTC_GEOMETRY_TYPE_QUAD);
+        rtcSetSharedGeometryBuffer(
+            geom,
+            RTC_BUFFER_TYPE_VERTEX,
+            0,
+            RTC_FORMAT_FLOAT3,
+            buffers.vertices,
+            0,
+            3 * sizeof(float),
+            buffers.n_vertices
+        );
+        rtcSetSharedGeometryBuffer(
+            geom,
+            RTC_BUFFER_TYPE_INDEX,
+            0,
+            face_size == 3 ? RTC_FORMAT_UINT3 : RTC_FORMAT_UINT4,
+            buffers.faces,
+            0,
+            face_size * sizeof(unsigned int),
+            buffers.n_faces
+        );
+
+        geom_data.push_back({
+            .shape = ShapeType::OBJ,
+            .material = material,
+            .normals = buffers.normals,
+            .normal_indices = buffers.face_normals,
+            .face_size = face_size,
+            .vertices = buffers.vertices,
+            .faces = buffers.faces
+        });
+        if (!first) {
+            first = &geom_data.back();
+        }
+
+        rtcCommitGeometry(geom);
+        geom_data.back().geom_id = rtcAttachGeometry(scene, geom);
+        rtcReleaseGeometry(geom);
+    }
+    return first;
+}
+
+void Scene::set_cache_dir(const std::string& directory) {
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    if (error) {
+        std::cerr << "Unable to use " << directory << " as a cache: " << error.message() << std::endl;
+        return;
+    }
+    m_cache_dir = directory;
+}
+
+// changed whenever meshes are processed differently, so that older cache files are no longer used
+const uint64_t MESH_CACHE_VERSION = 2;
+
+std::string Scene::cache_file(const MappedFile& file, const Transform& transform) const {
+    if (m_cache_dir.empty()) {
+        return "";
+    }
+    // the processed mesh depends only on the file's contents and the transform, so those key the cache
+    uint64_t key = hash_bytes(file.data(), file.size(), (uint64_t(MESH_FILE_VERSION) << 32) | MESH_CACHE_VERSION);
+    key = hash_bytes(transform.m_mat.data.data(), sizeof(transform.m_mat.data), key);
+    std::ostringstream name;
+    name << std::hex << std::setw(16) << std::setfill('0') << key << ".mesh";
+    return (m_cache_dir / name.str()).string();
+}
+
+// write a processed mesh to the cache; failing to is not an error, the mesh just won't be cached
+void write_cache_file(const std::string& cache_file, const obj::MeshData& mesh) {
+    // write to a temporary file first, so that no other render ever maps a half-written cache file
+    std::string temp_file = cache_file + "." + std::to_string(getpid()) + ".tmp";
+    std::error_code error;
+    if (write_mesh_file(temp_file, mesh)) {
+        std::filesystem::rename(temp_file, cache_file, error);
+    }
+    else {
+        std::filesystem::remove(temp_file, error);
+    }
+}
+
+GeometryData* Scene::attach_obj(
+    const std::string& filename,
+    const Transform& transform,
+    Material* material,
+    RTCScene scene,
+    std::deque<GeometryData>& geom_data
+) {
+    std::cerr << "Loading " << filename << "..." << std::endl;
+    auto file = MappedFile::open(filename);
+    if (!file) {
         std::cerr << "Failed to load " << filename << std::endl;
         return nullptr;
     }
-    auto obj = *obj_data;
-    if (obj.vertices.empty() || obj.faces.empty()) {
-        return nullptr;
+
+    std::string cached_name = cache_file(*file, transform);
+    if (!cached_name.empty()) {
+        if (auto cached = MeshFile::open(cached_name)) {
+            m_mesh_files.push_back(std::move(*cached));
+            return attach_mesh(m_device, scene, m_mesh_files.back(), material, geom_data);
+        }
     }
-    // use a quad mesh since the mesh may have both triangle and quad faces
-    RTCGeometry geom = rtcNewGeometry(
-        m_device,
-        RTC_GEOMETRY_TYPE_QUAD
-    );
-    float* vertex_buf = static_cast<float*>(rtcSetNewGeometryBuffer(
-        geom,
-        RTC_BUFFER_TYPE_VERTEX,
-        0,
-        RTC_FORMAT_FLOAT3,
-        3 * sizeof(float),
-        obj.vertices.size()
-    )); 
-    unsigned int* indices = static_cast<unsigned int*>(rtcSetNewGeometryBuffer(
-        geom,
-        RTC_BUFFER_TYPE_INDEX,
-        0,
-        RTC_FORMAT_UINT4,
-        4 * sizeof(unsigned int),
-        obj.faces.size()
-    ));
 
-    if (!vertex_buf || !indices) {
-        std::cerr << "Failed to create buffers for " << filename << std::endl;
+    obj::MeshData mesh = obj::parse_obj(file->view());
+    if (mesh.n_vertices() == 0 || mesh.n_faces() == 0) {
         return nullptr;
     }
+    transform_mesh(mesh, transform);
+    if (!cached_name.empty()) {
+        write_cache_file(cached_name, mesh);
+    }
+    m_meshes.push_back(std::move(mesh));
+    return attach_mesh(m_device, scene, m_meshes.back(), material, geom_data);
+}
 
-    for (size_t i = 0; i < obj.vertices.size(); i++) {
-        Pt3 p = transform * Pt3(
-            obj.vertices[i].x,
-            obj.vertices[i].y,
-            obj.vertices[i].z
-        );
-        vertex_buf[i * 3 + 0] = p.x;
-        vertex_buf[i * 3 + 1] = p.y;
-        vertex_buf[i * 3 + 2] = p.z;
+GeometryData* Scene::add_obj(const std::string& filename, Material* material, const Transform& transform) {
+    return attach_obj(filename, transform, material, m_scene, m_geom_data);
+}
+
+const MeshPrototype* Scene::load_mesh(const std::string& filename) {
+    auto it = m_prototype_index.find(filename);
+    if (it != m_prototype_index.end()) {
+        return it->second;
     }
+    MeshPrototype* mesh = filename.ends_with(".mesh") ? load_mesh_file(filename) : load_obj_mesh(filename);
+    if (mesh) {
+        m_prototype_index[filename] = mesh;
+    }
+    return mesh;
+}
 
-    for (size_t i = 0; i < obj.faces.size(); i++) {
-        const auto& vertices = obj.faces[i].vertices;
-        indices[i * 4 + 0] = vertices[0] - 1;
-        indices[i * 4 + 1] = vertices[1] - 1;
-        indices[i * 4 + 2] = vertices[2] - 1;
-        // if the face is a tri, this last vertex will be a duplicate of the previous
-        indices[i * 4 + 3] = vertices[3] - 1;
+MeshPrototype* Scene::load_obj_mesh(const std::string& filename) {
+    m_prototypes.push_back({ .scene = rtcNewScene(m_device) });
+    MeshPrototype* mesh = &m_prototypes.back();
+    // the mesh stays in its own object space; instances supply the transform
+    if (!attach_obj(filename, Transform::identity(), nullptr, mesh->scene, mesh->geom_data)) {
+        rtcReleaseScene(mesh->scene);
+        m_prototypes.pop_back();
+        return nullptr;
     }
+    rtcCommitScene(mesh->scene);
+    return mesh;
+}
 
-    std::unique_ptr<NormalData> normal_data;
-    if (!obj.vertex_normals.empty()) {
-        std::vector<Vec3> normals(obj.vertex_normals.size());
-        std::transform(obj.vertex_normals.begin(), obj.vertex_normals.end(), normals.begin(), [](const auto& v) {
-            return Vec3(v.x, v.y, v.z);
-        });
-        std::vector<std::array<int, 4>> faces(obj.faces.size());
-        std::transform(obj.faces.begin(), obj.faces.end(), faces.begin(), [](const auto& f) {
-            auto ns = f.normals;
-            return std::array<int, 4> { ns[0] - 1, ns[1] - 1, ns[2] - 1, ns[3] - 1 };
-        });
-        normal_data = std::make_unique<NormalData>(std::move(normals), std::move(faces));
+MeshPrototype* Scene::load_mesh_file(const std::string& filename) {
+    std::cerr << "Loading " << filename << "..." << std::endl;
+    auto file = MeshFile::open(filename);
+    if (!file) {
+        std::cerr << "Failed to load " << filename << std::endl;
+        return nullptr;
+    }
+    m_mesh_files.push_back(std::move(*file));
+    m_prototypes.push_back({ .scene = rtcNewScene(m_device) });
+    MeshPrototype* mesh = &m_prototypes.back();
+    attach_mesh(m_device, mesh->scene, m_mesh_files.back(), nullptr, mesh->geom_data);
+    rtcCommitScene(mesh->scene);
+    return mesh;
+}
+
+GeometryData* Scene::add_mesh_file(const std::string& filename, Material* material, const Transform& transform) {
+    return add_instance(load_mesh(filename), material, transform);
+}
+
+GeometryData* Scene::add_instance(const MeshPrototype* mesh, Material* material, const Transform& transform) {
+    if (!mesh) {
+        return nullptr;
     }
+    RTCGeometry geom = rtcNewGeometry(m_device, RTC_GEOMETRY_TYPE_INSTANCE);
+    rtcSetGeometryInstancedScene(geom, mesh->scene);
+    // the matrix is stored row-major, so its first 12 entries are the 3x4 affine part embree wants
+    rtcSetGeometryTransform(geom, 0, RTC_FORMAT_FLOAT3X4_ROW_MAJOR, transform.m_mat.data.data());
 
     m_geom_data.push_back({
         .shape = ShapeType::OBJ,
         .material = material,
-        .normals = std::move(normal_data)
+        .instanced = mesh,
+        .transform = transform
     });
     GeometryData* geom_data = &m_geom_data.back();
-    rtcSetGeometryUserData(geom, geom_data);
 
     rtcCommitGeometry(geom);
-    rtcAttachGeometry(m_scene, geom);
+    geom_data->geom_id = rtcAttachGeometry(m_scene, geom);
     rtcReleaseGeometry(geom);
-    
+
     return geom_data;
 }
 
-GeometryData* Scene::add_grid(const Image& image, const Material* material, const Transform& transform) {
+GeometryData* Scene::add_grid(const Image& image, Material* material, const Transform& transform) {
     auto geom = rtcNewGeometry(m_device, RTC_GEOMETRY_TYPE_GRID);
     float* vertex_buf = static_cast<float*>(rtcSetNewGeometryBuffer(
         geom,
@@ -420,10 +850,9 @@ GeometryData* Scene::add_grid(const Image& image, const Material* material, cons
         .material = material
     });
     GeometryData* geom_data = &m_geom_data.back();
-    rtcSetGeometryUserData(geom, geom_data);
 
     rtcCommitGeometry(geom);
-    rtcAttachGeometry(m_scene, geom);
+    geom_data->geom_id = rtcAttachGeometry(m_scene, geom);
     rtcReleaseGeometry(geom);
 
     return geom_data;
@@ -437,28 +866,27 @@ void Scene::add_light(std::unique_ptr<Light>&& light) {
         auto shape_type = shape->type();
         if (shape_type == ShapeType::SPHERE) {
             const Sphere* sphere = static_cast<const Sphere*>(shape);
-            auto geom_data = add_sphere(sphere->m_center, sphere->m_radius, nullptr);
-            if (geom_data) {
-                geom_data->light = area_light;
-            }
+            add_sphere(sphere->m_center, sphere->m_radius, nullptr);
         }
         else if (shape_type == ShapeType::QUAD) {
             const Quad* quad = static_cast<const Quad*>(shape);
             auto [a, b, c, d] = quad->get_vertices();
-            auto geom_data = add_quad(a, b, c, d, nullptr);
-            if (geom_data) {
-                geom_data->light = area_light;
-            }
+            add_quad(a, b, c, d, nullptr);
         }
         else {
             std::cerr << "Shape type not yet supported as an area light: " << shape->type() << std::endl;
             return;
         }
+        // the primitive just added is the last one in its batch
+        primitive_batch(shape_type, nullptr).lights.back() = area_light;
     }
+    light->set_index(m_lights.size());
     m_lights.push_back(std::move(light));
 }
 
 void Scene::set_bg_light(std::shared_ptr<const Spectrum> spectrum, float scale) {
     m_bg_light.spectrum = spectrum;
     m_bg_light.scale = scale;
+    // a null spectrum means no background light
+    m_bg_light.rgb = spectrum ? RGBColorSpace::sRGB()->illuminant_rgb(*spectrum) : RGB();
 }
\ No newline at end of file
@@ -2,10 +2,13 @@
 
 #include <array>
 #include <deque>
+#include <filesystem>
 #include <iostream>
 #include <limits>
+#include <map>
 #include <optional>
 #include <string>
+#include <vector>
 
 #include <embree4/rtcore.h>
 
@@ -13,9 +16,13 @@
 #include "image.hpp"
 #include "interaction.hpp"
 #include "light.hpp"
+#include "light_sampler.hpp"
 #include "material.hpp"
+#include "mesh_file.hpp"
+#include "obj/obj.hpp"
 #include "sampler.hpp"
 #include "ray.hpp"
+#include "transform.hpp"
 #include "vec.hpp"
 
 RTCDevice initialize_device();
@@ -23,20 +30,103 @@ RTCDevice initialize_device();
 struct BackgroundLight {
     std::shared_ptr<const Spectrum> spectrum;
     float scale = 1.0f;
+    // for RGB renders
+    RGB rgb;
+
+    SpectrumSample emission(const WavelengthSample& wavelengths) const {
+        if (wavelengths.is_rgb()) {
+            return SpectrumSample::from_rgb(rgb.x, rgb.y, rgb.z) * scale;
+        }
+        return SpectrumSample::from_spectrum(*spectrum, wavelengths) * scale;
+    }
 };
 
-struct NormalData {
-    // buffer of normal vectors for each vertex
-    std::vector<Vec3> normals;
-    // for each face, indices in the 'normals' buffer
-    std::vector<std::array<int, 4>> faces;
+// the parts of an embree hit record needed to build a SurfaceInteraction
+struct HitRecord {
+    float t;
+    Vec3 ng;
+    Vec2 uv;
+    unsigned int geom_id;
+    unsigned int prim_id;
+    // geometry ID of the instance that was hit, or RTC_INVALID_GEOMETRY_ID if the hit wasn't on an instance
+    unsigned int inst_id;
 };
 
+struct MeshPrototype;
+
 struct GeometryData {
+    // embree's ID for the geometry, within the scene it's attached to
+    unsigned int geom_id = RTC_INVALID_GEOMETRY_ID;
     ShapeType shape;
+    Material* material;
+    // area light for each primitive, indexed by primitive ID; empty if none of them are lights
+    std::vector<const AreaLight*> lights;
+    // for a mesh with vertex normals, the normals and, for each face, the indices of its corners' normals
+    // (face_size per face, -1 for a corner without one); these point into the buffers the mesh was built from
+    const std::array<float, 3>* normals = nullptr;
+    const int* normal_indices = nullptr;
+    // 3 for a mesh's triangles, 4 for its quads
+    unsigned int face_size = 4;
+    // the vertex buffer (4 floats, center and radius, per sphere; 3 floats per vertex otherwise), and for
+    // triangles and quads, face_size vertex indices per face; these point into the buffers embree reads
+    // nullptr for grids and instances
+    const float* vertices = nullptr;
+    const unsigned int* faces = nullptr;
+    // for an instance, the mesh it places, and the transform it was placed with
+    const MeshPrototype* instanced = nullptr;
+    std::optional<Transform> transform;
+};
+
+// a mesh loaded once into its own embree scene, so that it can be placed many times as instances
+struct MeshPrototype {
+    RTCScene scene;
+    // one for each geometry in the scene, indexed by geometry ID
+    std::deque<GeometryData> geom_data;
+};
+
+// what a hit needs to know about the top-level geometry it hit
+struct GeometryRecord {
     const Material* material;
-    const AreaLight* light;
-    std::unique_ptr<NormalData> normals;
+    // for an instance, its transform; nullptr otherwise
+    const Transform* transform;
+    // index in GeometryTable::shapes of the geometry's shape
+    // for an instance, of the shape of the first geometry in the instanced scene; the rest follow it in order
+    unsigned int shape;
+    // index in GeometryTable::lights of the light for the geometry's first primitive, or -1 if it has no lights
+    int lights;
+};
+
+// what a hit needs to know about the shape of the geometry it hit, for normal interpolation
+struct ShapeRecord {
+    const std::array<float, 3>* normals;
+    const int* normal_indices;
+    const float* vertices;
+    const unsigned int* faces;
+    ShapeType shape;
+    unsigned int face_size;
+};
+
+// the scene's GeometryData flattened into arrays indexed by geometry and primitive ID, built at commit
+// a hit reads a GeometryRecord and a ShapeRecord (and a light, if it has any) rather than asking embree for
+// the geometry's data and following its pointers
+struct GeometryTable {
+    // indexed by the geometry IDs of the top-level scene
+    std::vector<GeometryRecord> geometries;
+    std::vector<ShapeRecord> shapes;
+    std::vector<const AreaLight*> lights;
+};
+
+// triangles, quads or spheres sharing a material, waiting to be merged into one geometry at commit
+struct PrimitiveBatch {
+    ShapeType shape;
+    Material* material;
+    // 3 floats per vertex for triangles and quads, 4 (center and radius) per sphere
+    std::vector<float> vertices;
+    std::vector<const AreaLight*> lights;
+
+    size_t size() const {
+        return lights.size();
+    }
 };
 
 class Scene {
@@ -45,47 +135,83 @@ public:
 
     ~Scene() {
         rtcReleaseScene(m_scene);
+        for (auto& mesh : m_prototypes) {
+            rtcReleaseScene(mesh.scene);
+        }
         rtcReleaseDevice(m_device);
     }
 
+    // build the scene's geometries, and bake the spectra of its materials and lights into tables
+    // (see SpectrumBaker), which replaces the spectra they hold
     void commit();
     bool ready() const { return m_ready; }
 
     // intersect a single ray with the scene
     std::optional<SurfaceInteraction> ray_intersect(const Ray& ray, const WavelengthSample& wavelengths, Sampler& sampler) const;
+    // intersect a batch of rays with the scene, traced in packets of 16
+    // interactions is resized to match rays
+    // set coherent when neighboring rays have similar origins and directions (e.g. camera rays)
+    void ray_intersect(
+        const std::vector<Ray>& rays,
+        std::vector<std::optional<SurfaceInteraction>>& interactions,
+        bool coherent = false
+    ) const;
 
-    // sample illumination from lights at a given point
+    // sample illumination from lights at a given point, choosing the light as set by set_light_sampling
     std::pair<const Light*, float> sample_lights(const Pt3& point, const Vec3& normal, Sampler& sampler) const;
     // get proba of sampling a given light
     float light_sample_pmf(const Pt3& point, const Vec3& normal, const Light* light) const;
     // check if end is visible from start
+    // this is an any-hit query, so it's cheaper than ray_intersect
     bool occluded(Pt3 start, Pt3 end) const;
+    // check a batch of (start, end) segments for occlusion, traced in packets of 16
+    // result is resized to match segments; nonzero means occluded
+    void occluded(const std::vector<std::pair<Pt3, Pt3>>& segments, std::vector<char>& result) const;
 
-    // methods for adding shapes to scene; return geometry ID
+    // methods for adding shapes to scene
     // in cases where multiple points are required, they should be given in clockwise order around the outward face
+    // the scene doesn't own the materials shapes are added with, but it does change them: commit bakes their spectra
+    // into tables (see SpectrumBaker), so they must outlive the scene and can't be const
 
-    GeometryData* add_triangle(const Pt3& a, const Pt3& b, const Pt3& c, const Material* material);
-    GeometryData* add_sphere(const Pt3& center, float radius, const Material* material);
-    GeometryData* add_quad(const Pt3& a, const Pt3& b, const Pt3& c, const Pt3& d, const Material* material);
+    // triangles, spheres, quads and planes aren't given their own geometry; they're merged into
+    // one geometry per shape and material when the scene is committed
+    void add_triangle(const Pt3& a, const Pt3& b, const Pt3& c, Material* material);
+    void add_sphere(const Pt3& center, float radius, Material* material);
+    void add_quad(const Pt3& a, const Pt3& b, const Pt3& c, const Pt3& d, Material* material);
     // plane is just a large square quad centered around the given point
-    GeometryData* add_plane(const Pt3& p, const Vec3& n, const Material* material, float half_size = 1000.0f);
+    void add_plane(const Pt3& p, const Vec3& n, Material* material, float half_size = 1000.0f);
+
+    // add_obj and add_grid create their geometry immediately, and return its data
+
+    // keep a cache of processed .obj meshes in the given directory, which is created if needed
+    // a mesh is cached once its vertices and normals have been transformed, under a hash of the file's contents
+    // and the transform; later add_obj and load_mesh calls with the same inputs (in this run or later ones)
+    // map the cached mesh rather than parsing the file again
+    void set_cache_dir(const std::string& directory);
 
     // add objects from .obj (wavefront OBJ) file
-    GeometryData* add_obj(const std::string& filename, const Material* material, const Transform& transform = Transform::identity());
+    // the file's triangles and quads get a geometry each; this returns the data of the first
+    GeometryData* add_obj(const std::string& filename, Material* material, const Transform& transform = Transform::identity());
+
+    GeometryData* add_grid(const Image& image, Material* material, const Transform& transform = Transform::identity());
+
+    // add a binary .mesh file (see mesh_file.hpp), as written by the obj_to_mesh converter
+    // the file's buffers are mapped and handed to embree as they are, so it's placed as an instance of the mesh
+    GeometryData* add_mesh_file(const std::string& filename, Material* material, const Transform& transform = Transform::identity());
 
-    GeometryData* add_grid(const Image& image, const Material* material, const Transform& transform = Transform::identity());
+    // load a .obj or binary .mesh file so that it can be placed with add_instance; returns nullptr if loading fails
+    // each file is only loaded once, later calls with the same filename return the same mesh
+    const MeshPrototype* load_mesh(const std::string& filename);
+    // place a copy of a loaded mesh in the scene
+    // the mesh's vertices are shared between all of its instances, rather than copied for each one
+    GeometryData* add_instance(const MeshPrototype* mesh, Material* material, const Transform& transform = Transform::identity());
 
     // add a light to the scene
     void add_light(std::unique_ptr<Light>&& light);
 
-    // set properties of background (ambient) lighting
+    // set properties of background (ambient) lighting; a null spectrum means there is none
     void set_bg_light(std::shared_ptr<const Spectrum> spectrum, float scale = 1.0f);
 
-    const GeometryData* get_geom_data(unsigned int geom_id) const {
-        const void* ptr = rtcGetGeometryUserDataFromScene(m_scene, geom_id);
-        return static_cast<const GeometryData*>(ptr);
-    }
-
     RTCScene get_scene() const {
         return m_scene;
     }
@@ -95,7 +221,45 @@ public:
 
     const BackgroundLight& get_bg_light () const { return m_bg_light; }
 
+    // how integrators get the BSDFs of the scene's materials; see MaterialDispatch
+    void set_material_dispatch(MaterialDispatch dispatch) { m_material_dispatch = dispatch; }
+    MaterialDispatch material_dispatch() const { return m_material_dispatch; }
+
+    // whether the scene is rendered spectrally (the default) or in RGB; see ColorMode
+    void set_color_mode(ColorMode mode) { m_color_mode = mode; }
+    ColorMode color_mode() const { return m_color_mode; }
+
+    // how sample_lights chooses a light (by power, by default); see LightSampling
+    // the sampler is built from the lights when the scene is committed
+    void set_light_sampling(LightSampling sampling);
+    LightSampling light_sampling() const { return m_light_sampling; }
+
 private:
+    std::optional<SurfaceInteraction> surface_interaction(const Ray& ray, const HitRecord& hit) const;
+
+    // find (or start) the batch for primitives of the given shape and material
+    PrimitiveBatch& primitive_batch(ShapeType shape, Material* material);
+    // build an embree geometry for each pending batch and attach it to the scene
+    void commit_primitive_batches();
+    // rebuild m_geometry_table from the scene's GeometryData
+    void build_geometry_table();
+    // bake the spectra of every material and light in the scene into tables, see SpectrumBaker
+    void bake_spectra();
+    // load_mesh for each kind of file; these don't check whether the file is already loaded
+    MeshPrototype* load_obj_mesh(const std::string& filename);
+    MeshPrototype* load_mesh_file(const std::string& filename);
+    // load an .obj file moved by the given transform (from the cache, if it's there), then attach geometries for
+    // its triangles and quads to scene and add their data to geom_data; returns nullptr if loading fails
+    GeometryData* attach_obj(
+        const std::string& filename,
+        const Transform& transform,
+        Material* material,
+        RTCScene scene,
+        std::deque<GeometryData>& geom_data
+    );
+    // where a processed .obj file placed with the given transform is cached, or "" if there's no cache
+    std::string cache_file(const MappedFile& file, const Transform& transform) const;
+
     RTCScene m_scene;
     RTCDevice m_device;
 
@@ -103,6 +267,22 @@ private:
     // need to store data in a collection that doesn't reallocate on resize
     // since we'll be providing our geom objects with pointers to it
     std::deque<GeometryData> m_geom_data;
+    GeometryTable m_geometry_table;
     std::vector<std::unique_ptr<Light>> m_lights;
+    std::deque<MeshPrototype> m_prototypes;
+    // the buffers of every loaded mesh, which embree reads in place
+    std::deque<obj::MeshData> m_meshes;
+    std::deque<MeshFile> m_mesh_files;
+    std::filesystem::path m_cache_dir;
+    MaterialDispatch m_material_dispatch = MaterialDispatch::VIRTUAL;
+    ColorMode m_color_mode = ColorMode::SPECTRAL;
+    LightSampling m_light_sampling = LightSampling::POWER;
+    std::unique_ptr<LightSampler> m_light_sampler;
+    // kept between commits, so spectra shared by materials and lights added later are only baked once
+    SpectrumBaker m_spectrum_baker;
+    std::map<std::string, const MeshPrototype*> m_prototype_index;
+    // primitives added since the last commit, in the order their batches were started
+    std::vector<PrimitiveBatch> m_batches;
+    std::map<std::pair<ShapeType, Material*>, size_t> m_batch_index;
     bool m_ready = false;
 };
@@ -0,0 +1,81 @@
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "material.hpp"
+#include "mesh_file.hpp"
+#include "scene.hpp"
+
+// check that an .obj file cached by one scene is mapped from the cache by the next, rather than parsed again
+
+namespace fs = std::filesystem;
+
+namespace {
+
+int n_failures = 0;
+
+void check(bool ok, const std::string& name, const std::string& what) {
+    if (!ok) {
+        std::cout << name << ": " << what << std::endl;
+        n_failures++;
+    }
+}
+
+std::vector<fs::path> cache_files(const fs::path& directory) {
+    std::vector<fs::path> files;
+    for (const auto& entry : fs::directory_iterator(directory)) {
+        files.push_back(entry.path());
+    }
+    return files;
+}
+
+void check_reopens(const std::string& name, const std::string& obj_text, const fs::path& directory) {
+    fs::remove_all(directory);
+    fs::create_directories(directory);
+    fs::path obj_file = directory / "mesh.obj";
+    std::ofstream(obj_file) << obj_text;
+    fs::path cache_dir = directory / "cache";
+    DiffuseMaterial material(SolidColor(0.5, 0.5, 0.5));
+
+    {
+        Scene scene(initialize_device());
+        scene.set_cache_dir(cache_dir.string());
+        check(scene.add_obj(obj_file.string(), &material) != nullptr, name, "obj isn't added");
+    }
+    std::vector<fs::path> files = cache_files(cache_dir);
+    check(files.size() == 1, name, "expected one cache file, found " + std::to_string(files.size()));
+    if (files.size() != 1) {
+        return;
+    }
+    check(MeshFile::open(files[0].string()).has_value(), name, "cache file doesn't open");
+    auto written = fs::last_write_time(files[0]);
+
+    {
+        Scene scene(initialize_device());
+        scene.set_cache_dir(cache_dir.string());
+        check(scene.add_obj(obj_file.string(), &material) != nullptr, name, "obj isn't added from the cache");
+    }
+    check(cache_files(cache_dir).size() == 1, name, "cache gained files");
+    check(fs::last_write_time(files[0]) == written, name, "cache file was written again");
+}
+
+} // namespace
+
+int main() {
+    fs::path directory = fs::temp_directory_path() / "scene_cache_test";
+
+    const std::string positions =
+        "v 0 0 0\n"
+        "v 1 0 0\n"
+        "v 1 1 0\n"
+        "v 0 1 0\n";
+    check_reopens("no normals", positions + "f 1 2 3 4\n", directory);
+    check_reopens("normals", positions + "vn 0 0 1\nf 1//1 2//1 3//1 4//1\n", directory);
+    check_reopens("unreferenced normals", positions + "vn 0 0 1\nf 1 2 3 4\n", directory);
+
+    fs::remove_all(directory);
+    std::cout << n_failures << " failures" << std::endl;
+    return n_failures == 0 ? 0 : 1;
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cmath>
+#include <optional>
 #include <tuple>
 
 #include "sampler.hpp"
@@ -20,9 +21,14 @@ struct ShapeSample {
     float pdf;
 };
 
+// the nearest distance along a ray that counts as hitting a shape, as for the rays the scene traces
+const float SHAPE_T_MIN = 0.0001f;
+
 // currently used just to sample points on a shape
 class Shape {
 public:
+    virtual ~Shape() = default;
+
     // randomly sample a point on the shape's surface
     virtual ShapeSample sample_point(Vec2 sample2) const = 0;
     // get pdf for sampled point on the shape's surface
@@ -30,6 +36,9 @@ public:
     virtual float pdf(const Pt3& p) const {
         return 1.0f / area();
     }
+    // the first point where the ray from o along the unit vector d meets the shape, with its normal and the pdf
+    // sample_point gives it; nullopt if the ray misses
+    virtual std::optional<ShapeSample> intersect(const Pt3& o, const Vec3& d) const = 0;
     virtual ShapeType type() const = 0;
 };
 
@@ -56,6 +65,27 @@ public:
         return 1.0f / area();
     }
 
+    std::optional<ShapeSample> intersect(const Pt3& o, const Vec3& d) const override {
+        float d_n = d.dot(m_normal);
+        if (d_n == 0.0f) {
+            return std::nullopt;
+        }
+        float t = (m_p00 - o).dot(m_normal) / d_n;
+        if (!(t > SHAPE_T_MIN)) {
+            return std::nullopt;
+        }
+        Pt3 p = o + d * t;
+        // p - p00 = u du + v dv, so crossing it with dv or du leaves u or v times du x dv
+        Vec3 w = p - m_p00;
+        Vec3 n = m_du.cross(m_dv);
+        float u = w.cross(m_dv).dot(n) / n.norm_squared();
+        float v = m_du.cross(w).dot(n) / n.norm_squared();
+        if (u < 0.0f || u > 1.0f || v < 0.0f || v > 1.0f) {
+            return std::nullopt;
+        }
+        return ShapeSample { p, m_normal, 1.0f / area() };
+    }
+
     ShapeType type() const override {
         return QUAD;
     }
@@ -90,6 +120,26 @@ public:
         return 1.0f / area();
     }
 
+    std::optional<ShapeSample> intersect(const Pt3& o, const Vec3& d) const override {
+        Vec3 oc = o - m_center;
+        float b = oc.dot(d);
+        float c = oc.norm_squared() - m_radius * m_radius;
+        float discriminant = b * b - c;
+        if (discriminant < 0.0f) {
+            return std::nullopt;
+        }
+        float root = std::sqrt(discriminant);
+        float t = -b - root;
+        if (!(t > SHAPE_T_MIN)) {
+            t = -b + root;
+            if (!(t > SHAPE_T_MIN)) {
+                return std::nullopt;
+            }
+        }
+        Pt3 p = o + d * t;
+        return ShapeSample { p, (p - m_center) / m_radius, 1.0f / area() };
+    }
+
     ShapeType type() const override {
         return SPHERE;
     }
@@ -0,0 +1,283 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+
+#include "texels.hpp"
+
+namespace {
+
+float srgb_from_linear(float value) {
+    value = std::clamp(value, 0.0f, 1.0f);
+    return value <= 0.0031308f ? 12.92f * value : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+}
+
+// linear values of the 256 sRGB encoded bytes
+const std::array<float, 256>& linear_from_srgb8() {
+    static const std::array<float, 256> table = []() {
+        std::array<float, 256> table;
+        for (size_t i = 0; i < table.size(); i++) {
+            float value = i / 255.0f;
+            table[i] = value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+        }
+        return table;
+    }();
+    return table;
+}
+
+uint8_t srgb8_from_linear(float value) {
+    return static_cast<uint8_t>(std::lround(255.0f * srgb_from_linear(value)));
+}
+
+// a BC1 color, packed as 5 bits of red, 6 of green and 5 of blue, expanded back to bytes
+std::array<int, 3> expand_565(uint16_t color) {
+    int r = color >> 11;
+    int g = (color >> 5) & 0x3f;
+    int b = color & 0x1f;
+    return { (r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2) };
+}
+
+uint16_t pack_565(const std::array<float, 3>& color) {
+    auto quantize = [](float value, int max) {
+        return static_cast<uint16_t>(std::lround(std::clamp(value, 0.0f, 255.0f) * max / 255.0f));
+    };
+    return quantize(color[0], 31) << 11 | quantize(color[1], 63) << 5 | quantize(color[2], 31);
+}
+
+// one of the 4 colors a BC1 block with endpoints c0 and c1 can hold
+// with c0 > c1 they're the endpoints and two blends between them; otherwise the endpoints, their average and black
+std::array<int, 3> bc1_color(uint16_t c0, uint16_t c1, uint32_t index) {
+    std::array<int, 3> a = expand_565(c0);
+    std::array<int, 3> b = expand_565(c1);
+    switch (index) {
+    case 0:
+        return a;
+    case 1:
+        return b;
+    case 2:
+        if (c0 > c1) {
+            return { (2 * a[0] + b[0]) / 3, (2 * a[1] + b[1]) / 3, (2 * a[2] + b[2]) / 3 };
+        }
+        return { (a[0] + b[0]) / 2, (a[1] + b[1]) / 2, (a[2] + b[2]) / 2 };
+    default:
+        if (c0 > c1) {
+            return { (a[0] + 2 * b[0]) / 3, (a[1] + 2 * b[1]) / 3, (a[2] + 2 * b[2]) / 3 };
+        }
+        return { 0, 0, 0 };
+    }
+}
+
+// encode 16 texels of sRGB encoded colors in [0, 255] as a BC1 block
+// the endpoints are the extremes of the texels along the axis they vary most along
+void encode_bc1_block(const std::array<std::array<float, 3>, 16>& texels, uint8_t* block) {
+    std::array<float, 3> mean = {};
+    for (const auto& texel : texels) {
+        for (size_t c = 0; c < 3; c++) {
+            mean[c] += texel[c] / 16.0f;
+        }
+    }
+    float covariance[3][3] = {};
+    for (const auto& texel : texels) {
+        for (size_t i = 0; i < 3; i++) {
+            for (size_t j = 0; j < 3; j++) {
+                covariance[i][j] += (texel[i] - mean[i]) * (texel[j] - mean[j]);
+            }
+        }
+    }
+    // the principal axis, by power iteration
+    std::array<float, 3> axis = { 1.0f, 1.0f, 1.0f };
+    for (int iteration = 0; iteration < 8; iteration++) {
+        std::array<float, 3> next = {};
+        for (size_t i = 0; i < 3; i++) {
+            for (size_t j = 0; j < 3; j++) {
+                next[i] += covariance[i][j] * axis[j];
+            }
+        }
+        float length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+        if (length == 0.0f) {
+            break;
+        }
+        for (size_t i = 0; i < 3; i++) {
+            axis[i] = next[i] / length;
+        }
+    }
+    float t_min = 0.0f;
+    float t_max = 0.0f;
+    for (const auto& texel : texels) {
+        float t = 0.0f;
+        for (size_t c = 0; c < 3; c++) {
+            t += (texel[c] - mean[c]) * axis[c];
+        }
+        t_min = std::min(t_min, t);
+        t_max = std::max(t_max, t);
+    }
+    std::array<float, 3> high;
+    std::array<float, 3> low;
+    for (size_t c = 0; c < 3; c++) {
+        high[c] = mean[c] + t_max * axis[c];
+        low[c] = mean[c] + t_min * axis[c];
+    }
+    uint16_t c0 = pack_565(high);
+    uint16_t c1 = pack_565(low);
+    // 4 colors need c0 > c1; a block of one color uses just c0
+    if (c0 < c1) {
+        std::swap(c0, c1);
+    }
+
+    uint32_t indices = 0;
+    if (c0 != c1) {
+        std::array<std::array<int, 3>, 4> palette;
+        for (uint32_t p = 0; p < palette.size(); p++) {
+            palette[p] = bc1_color(c0, c1, p);
+        }
+        for (size_t i = 0; i < texels.size(); i++) {
+            uint32_t best = 0;
+            float best_distance = INFINITY;
+            for (uint32_t p = 0; p < palette.size(); p++) {
+                float distance = 0.0f;
+                for (size_t c = 0; c < 3; c++) {
+                    float d = texels[i][c] - palette[p][c];
+                    distance += d * d;
+                }
+                if (distance < best_distance) {
+                    best = p;
+                    best_distance = distance;
+                }
+            }
+            indices |= best << (2 * i);
+        }
+    }
+    // both colors and then the indices, least significant byte first
+    block[0] = c0 & 0xff;
+    block[1] = c0 >> 8;
+    block[2] = c1 & 0xff;
+    block[3] = c1 >> 8;
+    for (size_t i = 0; i < 4; i++) {
+        block[4 + i] = (indices >> (8 * i)) & 0xff;
+    }
+}
+
+} // namespace
+
+uint16_t half_from_float(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000;
+    uint32_t exponent = (bits >> 23) & 0xff;
+    uint32_t mantissa = bits & 0x7fffff;
+    if (exponent == 0xff) {
+        // infinity, or NaN, which keeps a mantissa bit so that it stays NaN
+        return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+    }
+    int half_exponent = int(exponent) - 127 + 15;
+    if (half_exponent >= 31) {
+        return sign | 0x7c00;
+    }
+    // round to nearest, ties to even; a carry out of the mantissa correctly bumps the exponent
+    auto round = [](uint32_t value, uint32_t shift) {
+        uint32_t result = value >> shift;
+        uint32_t remainder = value & ((1u << shift) - 1);
+        uint32_t half = 1u << (shift - 1);
+        return result + (remainder > half || (remainder == half && (result & 1)));
+    };
+    if (half_exponent <= 0) {
+        // too small for a normal half; subnormal halves count in steps of 2^-24
+        if (half_exponent < -10) {
+            return sign;
+        }
+        return sign | round(mantissa | 0x800000, 14 - half_exponent);
+    }
+    return sign | round(half_exponent << 23 | mantissa, 13);
+}
+
+float float_from_half(uint16_t half) {
+    uint32_t sign = uint32_t(half & 0x8000) << 16;
+    uint32_t exponent = (half >> 10) & 0x1f;
+    uint32_t mantissa = half & 0x3ff;
+    if (exponent == 0) {
+        float value = mantissa * 0x1p-24f;
+        return sign ? -value : value;
+    }
+    uint32_t bits = sign | (exponent == 31 ? 0xff << 23 : (exponent + 112) << 23) | mantissa << 13;
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+TexelBuffer::TexelBuffer(const std::vector<float>& rgb, size_t width, size_t height, TexelFormat format)
+    : m_format(format), m_width(width), m_height(height) {
+    size_t n_texels = width * height;
+    switch (format) {
+    case TexelFormat::FLOAT:
+        m_data.resize(n_texels * 3 * sizeof(float));
+        std::memcpy(m_data.data(), rgb.data(), m_data.size());
+        break;
+    case TexelFormat::HALF:
+        m_data.resize(n_texels * 3 * sizeof(uint16_t));
+        for (size_t i = 0; i < 3 * n_texels; i++) {
+            uint16_t half = half_from_float(rgb[i]);
+            std::memcpy(&m_data[i * sizeof(uint16_t)], &half, sizeof(half));
+        }
+        break;
+    case TexelFormat::SRGB8:
+        m_data.resize(n_texels * 3);
+        for (size_t i = 0; i < 3 * n_texels; i++) {
+            m_data[i] = srgb8_from_linear(rgb[i]);
+        }
+        break;
+    case TexelFormat::BC1_SRGB: {
+        size_t blocks_x = (width + 3) / 4;
+        size_t blocks_y = (height + 3) / 4;
+        m_data.resize(blocks_x * blocks_y * 8);
+        for (size_t by = 0; by < blocks_y; by++) {
+            for (size_t bx = 0; bx < blocks_x; bx++) {
+                // blocks past the right and bottom edges repeat the edge
+                std::array<std::array<float, 3>, 16> texels;
+                for (size_t i = 0; i < 16; i++) {
+                    size_t x = std::min(4 * bx + i % 4, width - 1);
+                    size_t y = std::min(4 * by + i / 4, height - 1);
+                    for (size_t c = 0; c < 3; c++) {
+                        texels[i][c] = 255.0f * srgb_from_linear(rgb[3 * (y * width + x) + c]);
+                    }
+                }
+                encode_bc1_block(texels, &m_data[8 * (by * blocks_x + bx)]);
+            }
+        }
+        break;
+    }
+    }
+}
+
+RGB TexelBuffer::rgb(size_t x, size_t y) const {
+    size_t i = 3 * (y * m_width + x);
+    switch (m_format) {
+    case TexelFormat::FLOAT: {
+        float values[3];
+        std::memcpy(values, &m_data[i * sizeof(float)], sizeof(values));
+        return RGB(values[0], values[1], values[2]);
+    }
+    case TexelFormat::HALF: {
+        uint16_t values[3];
+        std::memcpy(values, &m_data[i * sizeof(uint16_t)], sizeof(values));
+        return RGB(float_from_half(values[0]), float_from_half(values[1]), float_from_half(values[2]));
+    }
+    case TexelFormat::SRGB8: {
+        const auto& linear = linear_from_srgb8();
+        return RGB(linear[m_data[i]], linear[m_data[i + 1]], linear[m_data[i + 2]]);
+    }
+    case TexelFormat::BC1_SRGB:
+        return decode_bc1(x, y);
+    }
+    return RGB();
+}
+
+RGB TexelBuffer::decode_bc1(size_t x, size_t y) const {
+    const uint8_t* block = &m_data[8 * (y / 4 * ((m_width + 3) / 4) + x / 4)];
+    uint16_t c0 = block[0] | block[1] << 8;
+    uint16_t c1 = block[2] | block[3] << 8;
+    uint32_t indices = block[4] | block[5] << 8 | block[6] << 16 | uint32_t(block[7]) << 24;
+    uint32_t index = (indices >> (2 * (y % 4 * 4 + x % 4))) & 3;
+    std::array<int, 3> color = bc1_color(c0, c1, index);
+    const auto& linear = linear_from_srgb8();
+    return RGB(linear[color[0]], linear[color[1]], linear[color[2]]);
+}
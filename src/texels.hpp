@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "color/color.hpp"
+
+// how a TexelBuffer stores its texels
+enum class TexelFormat {
+    // 3 floats per texel, 12 bytes
+    FLOAT,
+    // 3 half floats per texel, 6 bytes
+    HALF,
+    // 3 sRGB encoded bytes per texel
+    SRGB8,
+    // blocks of 4x4 texels in 8 bytes each, as BC1 (DXT1) with sRGB encoded colors, half a byte per texel
+    // each block holds two colors and blends of them, so blocks with more than a gradient in them lose detail
+    BC1_SRGB,
+};
+
+// the texels of an image with 3 channels, stored in one of several formats and decoded to linear RGB as they're read
+class TexelBuffer {
+public:
+    // encode width x height texels of linear RGB, which the compact formats clamp to [0, 1]
+    TexelBuffer(const std::vector<float>& rgb, size_t width, size_t height, TexelFormat format);
+
+    RGB rgb(size_t x, size_t y) const;
+
+    TexelFormat format() const {
+        return m_format;
+    }
+    size_t size_bytes() const {
+        return m_data.size();
+    }
+
+private:
+    RGB decode_bc1(size_t x, size_t y) const;
+
+    TexelFormat m_format;
+    size_t m_width;
+    size_t m_height;
+    std::vector<uint8_t> m_data;
+};
+
+uint16_t half_from_float(float value);
+float float_from_half(uint16_t half);
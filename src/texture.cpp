@@ -1,12 +1,26 @@
+#include <algorithm>
+#include <array>
+
 #include "texture.hpp"
 
-SolidColor::SolidColor(const RGB& color, const RGBColorSpace& cs) : m_spectrum(std::make_shared<RGBSigmoidPolynomial>(cs.to_spectrum(color))) {}
+// reflectances are clamped to [0, 1], as they are when converted to spectra
+RGB clamp_reflectance(const RGB& rgb) {
+    return RGB(
+        std::clamp(rgb.x, 0.0f, 1.0f),
+        std::clamp(rgb.y, 0.0f, 1.0f),
+        std::clamp(rgb.z, 0.0f, 1.0f)
+    );
+}
+
+SolidColor::SolidColor(const RGB& color, const RGBColorSpace& cs) :
+    m_spectrum(std::make_shared<RGBSigmoidPolynomial>(cs.to_spectrum(color))),
+    m_rgb(clamp_reflectance(color))
+{}
 
-SpectrumSample SolidColor::value(
-    const Vec2& uv,
-    const Pt3& point,
-    const WavelengthSample& lambdas
-) const {
+SpectrumSample SolidColor::value(const TextureContext& ctx, const WavelengthSample& lambdas) const {
+    if (lambdas.is_rgb()) {
+        return SpectrumSample::from_rgb(m_rgb.x, m_rgb.y, m_rgb.z);
+    }
     return SpectrumSample::from_spectrum(*m_spectrum, lambdas);
 }
 
@@ -16,19 +30,21 @@ DummyTexture::DummyTexture() :
     black(RGBColorSpace::sRGB()->to_spectrum(RGB(0., 0., 0.)))
 {}
 
-SpectrumSample DummyTexture::value(
-    const Vec2& uv,
-    const Pt3& point,
-    const WavelengthSample& lambdas
-) const {
-    float u = uv.x * 10.;
-    float v = uv.y * 10.;
+SpectrumSample DummyTexture::value(const TextureContext& ctx, const WavelengthSample& lambdas) const {
+    float u = ctx.uv.x * 10.;
+    float v = ctx.uv.y * 10.;
     if (int(floorf(u) + floorf(v)) % 2 == 0) {
+        if (lambdas.is_rgb()) {
+            return SpectrumSample::from_rgb(1.0f, 1.0f, 1.0f);
+        }
         return SpectrumSample::from_spectrum(
             white, lambdas
         );
     }
     else {
+        if (lambdas.is_rgb()) {
+            return SpectrumSample::from_rgb(0.0f, 0.0f, 0.0f);
+        }
         return SpectrumSample::from_spectrum(
             black, lambdas
         );
@@ -36,26 +52,95 @@ SpectrumSample DummyTexture::value(
 }
 
 
-SpectrumSample ImageTexture::value(
-    const Vec2& uv,
-    const Pt3& point,
-    const WavelengthSample& lambdas
-) const {
-    size_t x = uv.x * image.width;
-    if (x == image.width) {
-        x = image.width - 1;
+std::vector<MipLevel> mip_map(Image&& image) {
+    std::vector<MipLevel> levels;
+    levels.push_back({ .width = image.width, .height = image.height, .rgb = std::move(image.color_buffer) });
+    // texels are reflectances, so they're clamped before they're averaged into smaller levels
+    for (float& value : levels[0].rgb) {
+        value = std::clamp(value, 0.0f, 1.0f);
     }
-    size_t y = uv.y * image.height;
-    if (y == image.height) {
-        y = image.height - 1;
+    while (levels.back().width > 1 || levels.back().height > 1) {
+        const MipLevel& fine = levels.back();
+        MipLevel coarse { .width = (fine.width + 1) / 2, .height = (fine.height + 1) / 2 };
+        coarse.rgb.resize(3 * coarse.width * coarse.height);
+        // an odd size repeats its last row or column
+        for (size_t y = 0; y < coarse.height; y++) {
+            for (size_t x = 0; x < coarse.width; x++) {
+                float* out = &coarse.rgb[3 * (y * coarse.width + x)];
+                for (size_t dy = 0; dy < 2; dy++) {
+                    for (size_t dx = 0; dx < 2; dx++) {
+                        size_t fx = std::min(2 * x + dx, fine.width - 1);
+                        size_t fy = std::min(2 * y + dy, fine.height - 1);
+                        const float* in = &fine.rgb[3 * (fy * fine.width + fx)];
+                        for (size_t c = 0; c < 3; c++) {
+                            out[c] += 0.25f * in[c];
+                        }
+                    }
+                }
+            }
+        }
+        levels.push_back(std::move(coarse));
     }
-    RGB rgb(image.color_buffer[3 * (y * image.width + x) + 0],
-            image.color_buffer[3 * (y * image.width + x) + 1],
-            image.color_buffer[3 * (y * image.width + x) + 2]);
+    return levels;
+}
 
-    auto spec = RGBColorSpace::sRGB()->to_spectrum(rgb);
-    return SpectrumSample::from_spectrum(
-        spec,
-        lambdas
-    );
+ImageTexture::ImageTexture(Image&& image, const RGBColorSpace& cs, TexelFormat format) : m_table(cs.m_table) {
+    for (MipLevel& level : mip_map(std::move(image))) {
+        std::vector<std::array<float, 3>> coefficients;
+        if (format == TexelFormat::FLOAT) {
+            coefficients.reserve(level.width * level.height);
+            for (size_t i = 0; i < level.rgb.size(); i += 3) {
+                RGBSigmoidPolynomial spec = cs.to_spectrum(RGB(level.rgb[i], level.rgb[i + 1], level.rgb[i + 2]));
+                coefficients.push_back({ spec.c0, spec.c1, spec.c2 });
+            }
+        }
+        m_levels.push_back({
+            .width = level.width,
+            .height = level.height,
+            .texels = TexelBuffer(level.rgb, level.width, level.height, format),
+            .coefficients = std::move(coefficients)
+        });
+    }
+}
+
+size_t ImageTexture::size_bytes() const {
+    size_t size = 0;
+    for (const Level& level : m_levels) {
+        size += level.texels.size_bytes() + level.coefficients.size() * sizeof(level.coefficients[0]);
+    }
+    return size;
+}
+
+SpectrumSample ImageTexture::value(const TextureContext& ctx, const WavelengthSample& lambdas) const {
+    bool spectral = !lambdas.is_rgb();
+    if (spectral && m_levels[0].texels.format() == TexelFormat::FLOAT) {
+        SpectrumSample::SampleArray values = {};
+        mip_filter(m_levels, ctx, [&](size_t l, size_t x, size_t y, float weight) {
+            const auto& c = m_levels[l].coefficients[y * m_levels[l].width + x];
+            RGBSigmoidPolynomial spec(c[0], c[1], c[2]);
+            for (size_t j = 0; j < N_SPECTRUM_SAMPLES; j++) {
+                values[j] += weight * spec(lambdas[j]);
+            }
+        });
+        return SpectrumSample(std::move(values));
+    }
+
+    RGB rgb;
+    mip_filter(m_levels, ctx, [&](size_t l, size_t x, size_t y, float weight) {
+        rgb += m_levels[l].texels.rgb(x, y) * weight;
+    });
+    if (!spectral) {
+        return SpectrumSample::from_rgb(rgb.x, rgb.y, rgb.z);
+    }
+    // compact textures keep no spectra, so the filtered color is converted instead
+    RGBSigmoidPolynomial spec = (*m_table)(RGB(
+        std::clamp(rgb.x, 0.0f, 1.0f),
+        std::clamp(rgb.y, 0.0f, 1.0f),
+        std::clamp(rgb.z, 0.0f, 1.0f)
+    ));
+    SpectrumSample::SampleArray values;
+    for (size_t j = 0; j < N_SPECTRUM_SAMPLES; j++) {
+        values[j] = spec(lambdas[j]);
+    }
+    return SpectrumSample(std::move(values));
 }
@@ -1,19 +1,99 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <cmath>
 #include <memory>
+#include <vector>
 
 #include "color/color.hpp"
 #include "image.hpp"
+#include "texels.hpp"
 #include "vec.hpp"
 
+// where a texture is looked up
+struct TextureContext {
+    Vec2 uv;
+    Pt3 point;
+    // how uv changes from one pixel to the next, which filtered textures average over
+    // zero gives the finest detail
+    Vec2 duvdx;
+    Vec2 duvdy;
+};
+
+
+// one level of a MIP map: a copy of an image at some fraction of its size
+struct MipLevel {
+    size_t width;
+    size_t height;
+    // linear RGB of each texel, row by row
+    std::vector<float> rgb;
+};
+
+// the MIP map of a reflectance image, from the image itself (clamped to [0, 1]) down to 1x1
+// each level is half the size of the one before, and each of its texels is the average of the 2x2 texels it covers
+std::vector<MipLevel> mip_map(Image&& image);
+
+// call tap(level, x, y, weight) for each texel that a trilinear lookup at ctx blends, with weights summing to 1
+// it interpolates between the two levels whose texels are closest in size to the area a pixel covers
+// levels can be anything with the width and height of each level of a MIP map
+template <typename Levels, typename F>
+void mip_filter(const Levels& levels, const TextureContext& ctx, F&& tap) {
+    // bilinear interpolation between the four texels around uv in one level
+    auto bilinear = [&](size_t l, float weight) {
+        size_t width = levels[l].width;
+        size_t height = levels[l].height;
+        // texel centers are at half-integer coordinates
+        float s = ctx.uv.x * width - 0.5f;
+        float t = ctx.uv.y * height - 0.5f;
+        float x0 = std::floor(s);
+        float y0 = std::floor(t);
+        float fx = s - x0;
+        float fy = t - y0;
+        // texels past the edges repeat the edge
+        auto clamp = [](float v, size_t size) {
+            return static_cast<size_t>(std::clamp(v, 0.0f, float(size - 1)));
+        };
+        size_t xs[2] = { clamp(x0, width), clamp(x0 + 1.0f, width) };
+        size_t ys[2] = { clamp(y0, height), clamp(y0 + 1.0f, height) };
+        float wx[2] = { 1.0f - fx, fx };
+        float wy[2] = { 1.0f - fy, fy };
+        for (size_t j = 0; j < 2; j++) {
+            for (size_t i = 0; i < 2; i++) {
+                float w = wx[i] * wy[j];
+                if (w > 0.0f) {
+                    tap(l, xs[i], ys[j], w * weight);
+                }
+            }
+        }
+    };
+
+    // the width of the area a pixel covers, in texels of the full image
+    float width = std::max({
+        std::abs(ctx.duvdx.x) * levels[0].width,
+        std::abs(ctx.duvdy.x) * levels[0].width,
+        std::abs(ctx.duvdx.y) * levels[0].height,
+        std::abs(ctx.duvdy.y) * levels[0].height
+    });
+    // each level's texels are twice as wide as the last's
+    float level = std::clamp(std::log2(std::max(width, 1.0f)), 0.0f, float(levels.size() - 1));
+    size_t fine = level;
+    float t = level - fine;
+    bilinear(fine, 1.0f - t);
+    if (t > 0.0f) {
+        bilinear(fine + 1, t);
+    }
+}
+
+
 class Texture {
 public:
-    virtual SpectrumSample value(
-        const Vec2& uv,
-        const Pt3& point,
-        const WavelengthSample& lambdas
-    ) const = 0;
+    virtual ~Texture() = default;
+
+    virtual SpectrumSample value(const TextureContext& ctx, const WavelengthSample& lambdas) const = 0;
+
+    // replace the texture's spectra with ones that are cheaper to evaluate, see SpectrumBaker
+    virtual void bake_spectra(SpectrumBaker& baker) {}
 };
 
 
@@ -29,15 +109,20 @@ public:
         const RGBColorSpace& cs = *RGBColorSpace::sRGB()
     ) : SolidColor(RGB(r, g, b), cs) {}
 
-    explicit SolidColor(const std::shared_ptr<const Spectrum>& spectrum) : m_spectrum(spectrum) {}
+    explicit SolidColor(
+        const std::shared_ptr<const Spectrum>& spectrum,
+        const RGBColorSpace& cs = *RGBColorSpace::sRGB()
+    ) : m_spectrum(spectrum), m_rgb(cs.reflectance_rgb(*spectrum)) {}
+
+    SpectrumSample value(const TextureContext& ctx, const WavelengthSample& lambdas) const override;
 
-    SpectrumSample value(
-        const Vec2& uv,
-        const Pt3& point,
-        const WavelengthSample& lambdas
-    ) const override;
+    void bake_spectra(SpectrumBaker& baker) override {
+        baker.bake(m_spectrum);
+    }
 
     std::shared_ptr<const Spectrum> m_spectrum;
+    // for RGB renders
+    RGB m_rgb;
 };
 
 
@@ -46,11 +131,7 @@ class DummyTexture : public Texture {
 public:
     DummyTexture();
 
-    SpectrumSample value(
-        const Vec2& uv,
-        const Pt3& point,
-        const WavelengthSample& lambdas
-    ) const override;
+    SpectrumSample value(const TextureContext& ctx, const WavelengthSample& lambdas) const override;
 
 private:
     RGBSigmoidPolynomial white;
@@ -58,15 +139,35 @@ private:
 };
 
 
+// an image, filtered with a MIP map (see mip_filter), so that distant surfaces read a few texels of a small level
+// rather than scattered texels of the full image
+// FLOAT textures find each texel's spectrum when they're made, so a lookup only has to evaluate it; the compact
+// formats instead convert the filtered color, which takes longer but needs a fraction of the memory
 class ImageTexture : public Texture {
 public:
-    explicit ImageTexture(Image&& image) : image(std::move(image)) {};
+    explicit ImageTexture(
+        Image&& image,
+        const RGBColorSpace& cs = *RGBColorSpace::sRGB(),
+        TexelFormat format = TexelFormat::FLOAT
+    );
+
+    SpectrumSample value(const TextureContext& ctx, const WavelengthSample& lambdas) const override;
 
-    SpectrumSample value(
-        const Vec2& uv,
-        const Pt3& point,
-        const WavelengthSample& lambdas
-    ) const override;
+    size_t n_levels() const {
+        return m_levels.size();
+    }
+    // memory taken by the texels of every level
+    size_t size_bytes() const;
 
-    Image image;
-};
\ No newline at end of file
+private:
+    struct Level {
+        size_t width;
+        size_t height;
+        TexelBuffer texels;
+        // the coefficients of each texel's RGBSigmoidPolynomial, in the same order as its texels; FLOAT textures only
+        std::vector<std::array<float, 3>> coefficients;
+    };
+
+    std::vector<Level> m_levels;
+    std::shared_ptr<const RGBToSpectrumTable> m_table;
+};
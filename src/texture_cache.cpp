@@ -0,0 +1,313 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <optional>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "texture_cache.hpp"
+
+struct TextureCache::Tile {
+    std::vector<TextureTexel> texels;
+    // the slot the tile is loaded into, or nullptr; only changed while holding the cache's mutex
+    std::atomic<Tile*>* slot = nullptr;
+    // lookups reading the tile; it can't be evicted while there are any
+    std::atomic<uint32_t> pins = 0;
+    // the cache's clock when the tile was last looked up
+    std::atomic<uint64_t> last_used = 0;
+};
+
+TextureCache::Tile TextureCache::LOADING;
+
+namespace {
+
+// read size bytes at offset into data; returns false if they can't all be read
+bool read_at(int fd, void* data, size_t size, uint64_t offset) {
+    char* out = static_cast<char*>(data);
+    while (size > 0) {
+        ssize_t n = pread(fd, out, size, offset);
+        if (n <= 0) {
+            return false;
+        }
+        out += n;
+        size -= n;
+        offset += n;
+    }
+    return true;
+}
+
+// the levels of a MIP map of an image of the given size, each made of tiles of tile_size x tile_size texels
+std::vector<TextureCache::Level> tiled_levels(size_t width, size_t height, size_t tile_size) {
+    std::vector<TextureCache::Level> levels;
+    size_t n_tiles = 0;
+    while (true) {
+        size_t tiles_x = (width + tile_size - 1) / tile_size;
+        size_t tiles_y = (height + tile_size - 1) / tile_size;
+        levels.push_back({ .width = width, .height = height, .tiles_x = tiles_x, .first_tile = n_tiles });
+        n_tiles += tiles_x * tiles_y;
+        if (width == 1 && height == 1) {
+            break;
+        }
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+    }
+    // one past the last level, so that its first tile is the number of tiles
+    levels.push_back({ .width = 0, .height = 0, .tiles_x = 0, .first_tile = n_tiles });
+    return levels;
+}
+
+// the counter for the calling thread's hits
+size_t hit_counter(size_t n_counters) {
+    thread_local size_t counter = std::hash<std::thread::id>()(std::this_thread::get_id());
+    return counter % n_counters;
+}
+
+} // namespace
+
+bool write_texture_file(const std::string& filename, Image&& image, const RGBColorSpace& cs, uint32_t tile_size) {
+    if (image.width == 0 || image.height == 0 || tile_size == 0) {
+        return false;
+    }
+    std::vector<MipLevel> levels = mip_map(std::move(image));
+    std::ofstream file(filename, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+
+    TextureFileHeader header = {};
+    std::memcpy(header.magic, TEXTURE_FILE_MAGIC, sizeof(header.magic));
+    header.version = TEXTURE_FILE_VERSION;
+    header.tile_size = tile_size;
+    header.width = levels[0].width;
+    header.height = levels[0].height;
+    header.n_levels = levels.size();
+    header.tiles = sizeof(header);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    std::vector<TextureTexel> tile(tile_size * tile_size);
+    for (const MipLevel& level : levels) {
+        for (size_t ty = 0; ty < level.height; ty += tile_size) {
+            for (size_t tx = 0; tx < level.width; tx += tile_size) {
+                std::fill(tile.begin(), tile.end(), TextureTexel {});
+                for (size_t y = ty; y < std::min<size_t>(ty + tile_size, level.height); y++) {
+                    for (size_t x = tx; x < std::min<size_t>(tx + tile_size, level.width); x++) {
+                        const float* rgb = &level.rgb[3 * (y * level.width + x)];
+                        RGBSigmoidPolynomial spec = cs.to_spectrum(RGB(rgb[0], rgb[1], rgb[2]));
+                        tile[(y - ty) * tile_size + (x - tx)] = {
+                            .rgb = { rgb[0], rgb[1], rgb[2] },
+                            .coefficients = { spec.c0, spec.c1, spec.c2 }
+                        };
+                    }
+                }
+                file.write(reinterpret_cast<const char*>(tile.data()), tile.size() * sizeof(TextureTexel));
+            }
+        }
+    }
+    return static_cast<bool>(file);
+}
+
+TextureCache::TextureCache(size_t memory_budget, uint32_t tile_size)
+    : m_tile_size(tile_size),
+      m_max_tiles(std::max<size_t>(1, memory_budget / (tile_size * tile_size * sizeof(TextureTexel)))) {}
+
+TextureCache::~TextureCache() {
+    for (File& file : m_files) {
+        close(file.fd);
+    }
+}
+
+const TextureCache::File* TextureCache::open(const std::string& filename) {
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
+    TextureFileHeader h;
+    struct stat st;
+    bool valid = fstat(fd, &st) == 0
+        && read_at(fd, &h, sizeof(h), 0)
+        && std::memcmp(h.magic, TEXTURE_FILE_MAGIC, sizeof(h.magic)) == 0
+        && h.version == TEXTURE_FILE_VERSION
+        && h.tile_size == m_tile_size
+        // sizes beyond these are surely corrupt, and would overflow the tile count
+        && h.width > 0 && h.width <= UINT32_MAX
+        && h.height > 0 && h.height <= UINT32_MAX;
+    std::vector<Level> levels;
+    size_t n_tiles = 0;
+    if (valid) {
+        levels = tiled_levels(h.width, h.height, m_tile_size);
+        n_tiles = levels.back().first_tile;
+        levels.pop_back();
+        uint64_t size = st.st_size;
+        uint64_t tile_bytes = m_tile_size * m_tile_size * sizeof(TextureTexel);
+        valid = h.n_levels == levels.size() && h.tiles <= size && (size - h.tiles) / tile_bytes >= n_tiles;
+    }
+    if (!valid) {
+        close(fd);
+        return nullptr;
+    }
+
+    return &m_files.emplace_back(File {
+        .fd = fd,
+        .tiles = h.tiles,
+        .levels = std::move(levels),
+        .slots = std::make_unique<std::atomic<Tile*>[]>(n_tiles)
+    });
+}
+
+// a loaded tile is only read between pinning it and unpinning it, and only once it's seen to still be in its slot
+// after being pinned; eviction takes a tile out of its slot and only then checks that it isn't pinned, so either the
+// lookup sees that it's gone, or the eviction sees that it's pinned and puts it back
+const TextureTexel* TextureCache::find(std::atomic<Tile*>& slot, size_t index, Tile*& pinned) {
+    // tiles aren't freed while the cache exists, so the tile is safe to pin even if it's evicted meanwhile
+    Tile* tile = slot.load(std::memory_order_acquire);
+    if (!tile || tile == &LOADING) {
+        return nullptr;
+    }
+    tile->pins.fetch_add(1);
+    if (slot.load() != tile) {
+        tile->pins.fetch_sub(1, std::memory_order_release);
+        return nullptr;
+    }
+    // most lookups are of tiles that were already looked up since the last load, so skip writing the same time
+    uint64_t now = m_clock.load(std::memory_order_relaxed);
+    if (tile->last_used.load(std::memory_order_relaxed) != now) {
+        tile->last_used.store(now, std::memory_order_relaxed);
+    }
+    pinned = tile;
+    return &tile->texels[index];
+}
+
+TextureTexel TextureCache::texel(const File& file, size_t level, size_t x, size_t y) {
+    const Level& l = file.levels[level];
+    size_t tile_index = l.first_tile + y / m_tile_size * l.tiles_x + x / m_tile_size;
+    size_t index = y % m_tile_size * m_tile_size + x % m_tile_size;
+    std::atomic<Tile*>& slot = file.slots[tile_index];
+
+    auto hit = [&]() -> std::optional<TextureTexel> {
+        Tile* pinned;
+        const TextureTexel* found = find(slot, index, pinned);
+        if (!found) {
+            return std::nullopt;
+        }
+        TextureTexel texel = *found;
+        pinned->pins.fetch_sub(1, std::memory_order_release);
+        m_hits[hit_counter(N_HIT_COUNTERS)].hits.fetch_add(1, std::memory_order_relaxed);
+        return texel;
+    };
+    uint64_t tile_bytes = m_tile_size * m_tile_size * sizeof(TextureTexel);
+    uint64_t offset = file.tiles + tile_index * tile_bytes;
+    Tile* tile;
+    while (true) {
+        if (auto texel = hit()) {
+            return *texel;
+        }
+        std::unique_lock<std::mutex> lock(m_mutex);
+        Tile* current = slot.load(std::memory_order_acquire);
+        if (current == &LOADING) {
+            // another thread is reading the tile, so wait for it rather than read it again
+            m_loaded.wait(lock, [&]() { return slot.load(std::memory_order_acquire) != &LOADING; });
+            continue;
+        }
+        if (current) {
+            // another thread loaded the tile while this one waited for the lock
+            continue;
+        }
+        m_misses.fetch_add(1, std::memory_order_relaxed);
+        tile = victim();
+        if (!tile) {
+            // every tile is being read, so read just this texel rather than wait
+            lock.unlock();
+            TextureTexel texel = {};
+            if (!read_at(file.fd, &texel, sizeof(texel), offset + index * sizeof(texel))) {
+                std::cerr << "Failed to read texture tile " << tile_index << std::endl;
+            }
+            return texel;
+        }
+        // pinned until it's published, so that it isn't chosen to be evicted while it's out of any slot
+        tile->pins.store(1, std::memory_order_relaxed);
+        slot.store(&LOADING, std::memory_order_relaxed);
+        break;
+    }
+
+    if (!read_at(file.fd, tile->texels.data(), tile_bytes, offset)) {
+        std::cerr << "Failed to read texture tile " << tile_index << std::endl;
+        std::fill(tile->texels.begin(), tile->texels.end(), TextureTexel {});
+    }
+    // the tile can be evicted as soon as it's unpinned, so take the texel first
+    TextureTexel texel = tile->texels[index];
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        tile->last_used.store(m_clock.fetch_add(1, std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        tile->slot = &slot;
+        slot.store(tile, std::memory_order_release);
+    }
+    tile->pins.fetch_sub(1, std::memory_order_release);
+    m_loaded.notify_all();
+    return texel;
+}
+
+TextureCache::Tile* TextureCache::victim() {
+    if (m_tiles.size() < m_max_tiles) {
+        auto& tile = m_tiles.emplace_back(std::make_unique<Tile>());
+        tile->texels.resize(m_tile_size * m_tile_size);
+        return tile.get();
+    }
+    // a tile can be pinned again between being chosen and being taken out of its slot, so try a few times
+    for (int attempt = 0; attempt < 4; attempt++) {
+        Tile* oldest = nullptr;
+        for (const auto& tile : m_tiles) {
+            if (tile->pins.load(std::memory_order_relaxed) == 0
+                && (!oldest || tile->last_used.load(std::memory_order_relaxed) < oldest->last_used.load(std::memory_order_relaxed))) {
+                oldest = tile.get();
+            }
+        }
+        if (!oldest) {
+            return nullptr;
+        }
+        oldest->slot->store(nullptr);
+        if (oldest->pins.load() == 0) {
+            oldest->slot = nullptr;
+            m_evictions.fetch_add(1, std::memory_order_relaxed);
+            return oldest;
+        }
+        oldest->slot->store(oldest, std::memory_order_release);
+    }
+    return nullptr;
+}
+
+TextureCacheStats TextureCache::stats() const {
+    TextureCacheStats stats = {
+        .hits = 0,
+        .misses = m_misses.load(std::memory_order_relaxed),
+        .evictions = m_evictions.load(std::memory_order_relaxed)
+    };
+    for (const HitCounter& counter : m_hits) {
+        stats.hits += counter.hits.load(std::memory_order_relaxed);
+    }
+    return stats;
+}
+
+SpectrumSample TiledImageTexture::value(const TextureContext& ctx, const WavelengthSample& lambdas) const {
+    if (lambdas.is_rgb()) {
+        RGB rgb;
+        mip_filter(m_file.levels, ctx, [&](size_t l, size_t x, size_t y, float weight) {
+            TextureTexel texel = m_cache.texel(m_file, l, x, y);
+            rgb += Vec3(texel.rgb[0], texel.rgb[1], texel.rgb[2]) * weight;
+        });
+        return SpectrumSample::from_rgb(rgb.x, rgb.y, rgb.z);
+    }
+    SpectrumSample::SampleArray values = {};
+    mip_filter(m_file.levels, ctx, [&](size_t l, size_t x, size_t y, float weight) {
+        TextureTexel texel = m_cache.texel(m_file, l, x, y);
+        RGBSigmoidPolynomial spec(texel.coefficients[0], texel.coefficients[1], texel.coefficients[2]);
+        for (size_t j = 0; j < N_SPECTRUM_SAMPLES; j++) {
+            values[j] += weight * spec(lambdas[j]);
+        }
+    });
+    return SpectrumSample(std::move(values));
+}
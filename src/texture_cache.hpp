@@ -0,0 +1,153 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "color/color.hpp"
+#include "image.hpp"
+#include "texture.hpp"
+
+// tiled texture files hold the MIP map of an image (see mip_map) in square tiles, so that a renderer can read just the
+// tiles it looks up rather than the whole image
+//
+// a file is a TextureFileHeader followed, at the offset it gives, by the tiles of each level in turn, from the full
+// image down to 1x1
+// level l is ceil(width / 2^l) x ceil(height / 2^l) texels, split into rows of tiles; each tile is
+// tile_size x tile_size TextureTexels in rows, and tiles at the right and bottom of a level are padded with zeros
+// all values are in the byte order of the machine that wrote the file
+
+constexpr char TEXTURE_FILE_MAGIC[8] = "QZTEX";
+constexpr uint32_t TEXTURE_FILE_VERSION = 1;
+
+struct TextureFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t tile_size;
+    uint64_t width;
+    uint64_t height;
+    uint64_t n_levels;
+    // offset of the first tile from the start of the file, in bytes
+    uint64_t tiles;
+};
+
+// one texel of a tiled texture: its linear RGB, and the coefficients of its RGBSigmoidPolynomial in the color space
+// the file was written for
+struct TextureTexel {
+    std::array<float, 3> rgb;
+    std::array<float, 3> coefficients;
+};
+
+// write an image as a tiled texture file; returns false if the file can't be written
+bool write_texture_file(
+    const std::string& filename,
+    Image&& image,
+    const RGBColorSpace& cs = *RGBColorSpace::sRGB(),
+    uint32_t tile_size = 32
+);
+
+struct TextureCacheStats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+};
+
+// keeps the tiles of tiled texture files that were looked up recently in memory, up to a budget
+// a tile is read from its file the first time it's looked up, and once the budget is used up, each tile that's read
+// replaces the one that was looked up least recently
+// lookups of tiles that are already loaded take no locks, so that render threads don't wait for each other
+// loading a tile only takes a lock to claim the tile's slot and to publish it once it's read, so that two threads
+// never load the same tile; the read itself is unlocked, and other threads that need the tile meanwhile wait for it
+class TextureCache {
+private:
+    struct Tile;
+
+public:
+    // the size of one level of a file's MIP map, and where its tiles start
+    struct Level {
+        size_t width;
+        size_t height;
+        size_t tiles_x;
+        size_t first_tile;
+    };
+
+    // a tiled texture file the cache reads tiles from
+    struct File {
+        int fd;
+        uint64_t tiles;
+        std::vector<Level> levels;
+        // the tile loaded for each tile of the file, LOADING while it's being read, or nullptr if it isn't loaded
+        std::unique_ptr<std::atomic<Tile*>[]> slots;
+    };
+
+    // memory_budget is the most bytes of texels to keep loaded, though at least one tile always is
+    // every file the cache opens must have tiles of tile_size x tile_size texels
+    explicit TextureCache(size_t memory_budget, uint32_t tile_size = 32);
+    TextureCache(const TextureCache&) = delete;
+    TextureCache& operator=(const TextureCache&) = delete;
+    ~TextureCache();
+
+    // open a tiled texture file to look up its texels; returns nullptr if it can't be opened, isn't a valid file, or
+    // has tiles of another size
+    // files stay open as long as the cache does
+    // this isn't thread safe, so open every file before rendering
+    const File* open(const std::string& filename);
+
+    // one texel of one level of a file
+    TextureTexel texel(const File& file, size_t level, size_t x, size_t y);
+
+    TextureCacheStats stats() const;
+
+private:
+    // a texel that's loaded, or nullptr; pins the tile it's in if it isn't nullptr
+    const TextureTexel* find(std::atomic<Tile*>& slot, size_t index, Tile*& pinned);
+    // a tile to load another into: a new one while the budget allows, otherwise the least recently used one that
+    // isn't pinned, which is taken out of its slot
+    // nullptr if every tile is pinned
+    Tile* victim();
+
+    // stands in for a tile in the slot of one that's being read
+    static Tile LOADING;
+
+    uint32_t m_tile_size;
+    size_t m_max_tiles;
+    std::deque<File> m_files;
+    std::vector<std::unique_ptr<Tile>> m_tiles;
+    // held while claiming a slot to load a tile into (and choosing which tile to evict for it), and while publishing
+    // the tile once it's read
+    std::mutex m_mutex;
+    // notified whenever a tile is published, for threads waiting on a slot that was LOADING
+    std::condition_variable m_loaded;
+    // counts tiles loaded, so that tiles looked up since the last load have the latest time
+    std::atomic<uint64_t> m_clock = 0;
+
+    // hits are counted separately for threads in different groups, so that they don't all write the same counter
+    struct alignas(64) HitCounter {
+        std::atomic<uint64_t> hits = 0;
+    };
+    static constexpr size_t N_HIT_COUNTERS = 16;
+    std::array<HitCounter, N_HIT_COUNTERS> m_hits;
+    std::atomic<uint64_t> m_misses = 0;
+    std::atomic<uint64_t> m_evictions = 0;
+};
+
+// an image texture whose texels are read from a tiled texture file through a TextureCache, so that it needn't all be
+// in memory
+// looks the same as an ImageTexture made from the same image and color space
+class TiledImageTexture : public Texture {
+public:
+    TiledImageTexture(TextureCache& cache, const TextureCache::File& file) : m_cache(cache), m_file(file) {}
+
+    SpectrumSample value(const TextureContext& ctx, const WavelengthSample& lambdas) const override;
+
+private:
+    TextureCache& m_cache;
+    const TextureCache::File& m_file;
+};
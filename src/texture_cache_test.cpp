@@ -0,0 +1,150 @@
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <latch>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "texture_cache.hpp"
+
+// check that a TextureCache gives the texels written to a tiled texture file, as tiles are evicted under a small
+// budget and as many threads look up the same tiles at once
+
+namespace {
+
+const uint32_t TILE_SIZE = 4;
+const size_t TILE_BYTES = TILE_SIZE * TILE_SIZE * sizeof(TextureTexel);
+
+int n_failures = 0;
+
+void check(bool ok, const std::string& name, const std::string& what) {
+    if (!ok) {
+        std::cout << name << ": " << what << std::endl;
+        n_failures++;
+    }
+}
+
+// an image whose texels all differ, so that reading the wrong tile or texel shows
+Image test_image(size_t width, size_t height) {
+    Image image(height, width);
+    for (size_t i = 0; i < image.color_buffer.size(); i++) {
+        image.color_buffer[i] = (i % 251) / 251.0f;
+    }
+    return image;
+}
+
+bool same_rgb(const TextureTexel& texel, const MipLevel& level, size_t x, size_t y) {
+    const float* rgb = &level.rgb[3 * (y * level.width + x)];
+    return texel.rgb[0] == rgb[0] && texel.rgb[1] == rgb[1] && texel.rgb[2] == rgb[2];
+}
+
+void test_eviction(const std::string& filename, const std::vector<MipLevel>& levels) {
+    const std::string name = "eviction";
+    // room for just two tiles
+    TextureCache cache(2 * TILE_BYTES, TILE_SIZE);
+    const TextureCache::File* file = cache.open(filename);
+    if (!file) {
+        check(false, name, "file doesn't open");
+        return;
+    }
+    // three tiles along the top of the image, A, B and C
+    check(same_rgb(cache.texel(*file, 0, 0, 0), levels[0], 0, 0), name, "wrong texel in tile A");
+    check(same_rgb(cache.texel(*file, 0, TILE_SIZE, 0), levels[0], TILE_SIZE, 0), name, "wrong texel in tile B");
+    TextureCacheStats stats = cache.stats();
+    check(stats.misses == 2 && stats.hits == 0 && stats.evictions == 0, name, "loading two tiles evicted one");
+
+    // A was loaded before B, so it's the one C replaces
+    check(same_rgb(cache.texel(*file, 0, 2 * TILE_SIZE, 0), levels[0], 2 * TILE_SIZE, 0), name, "wrong texel in tile C");
+    check(same_rgb(cache.texel(*file, 0, TILE_SIZE + 1, 2), levels[0], TILE_SIZE + 1, 2), name, "wrong texel in tile B");
+    stats = cache.stats();
+    check(stats.misses == 3 && stats.hits == 1 && stats.evictions == 1, name, "tile C didn't replace tile A");
+    check(same_rgb(cache.texel(*file, 0, 3, 3), levels[0], 3, 3), name, "wrong texel in tile A");
+    check(cache.stats().misses == 4, name, "tile A wasn't evicted");
+}
+
+// every thread looks up texels of every level at random through a cache with room for two tiles, so that tiles are
+// pinned by some threads while others evict them
+void test_pinning(const std::string& filename, const std::vector<MipLevel>& levels, size_t n_threads) {
+    const std::string name = "pinning";
+    TextureCache cache(2 * TILE_BYTES, TILE_SIZE);
+    const TextureCache::File* file = cache.open(filename);
+    if (!file) {
+        check(false, name, "file doesn't open");
+        return;
+    }
+    std::vector<int> wrong(n_threads);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < n_threads; t++) {
+        threads.emplace_back([&, t]() {
+            std::mt19937 rng(t);
+            for (int i = 0; i < 20000; i++) {
+                size_t l = rng() % levels.size();
+                size_t x = rng() % levels[l].width;
+                size_t y = rng() % levels[l].height;
+                wrong[t] += !same_rgb(cache.texel(*file, l, x, y), levels[l], x, y);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (int w : wrong) {
+        check(w == 0, name, std::to_string(w) + " wrong texels");
+    }
+}
+
+// threads that miss on the same tile at once should read it just once between them
+void test_concurrent_misses(const std::string& filename, const std::vector<MipLevel>& levels, size_t n_threads) {
+    const std::string name = "concurrent misses";
+    TextureCache cache(4 * TILE_BYTES, TILE_SIZE);
+    const TextureCache::File* file = cache.open(filename);
+    if (!file) {
+        check(false, name, "file doesn't open");
+        return;
+    }
+    std::latch start(n_threads);
+    std::vector<int> wrong(n_threads);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < n_threads; t++) {
+        threads.emplace_back([&, t]() {
+            start.arrive_and_wait();
+            size_t x = TILE_SIZE + t % TILE_SIZE;
+            size_t y = t / TILE_SIZE % TILE_SIZE;
+            wrong[t] += !same_rgb(cache.texel(*file, 0, x, y), levels[0], x, y);
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (int w : wrong) {
+        check(w == 0, name, "wrong texel");
+    }
+    TextureCacheStats stats = cache.stats();
+    check(stats.misses == 1, name, "the tile was read " + std::to_string(stats.misses) + " times");
+    check(stats.hits == n_threads - 1, name, std::to_string(stats.hits) + " hits");
+}
+
+} // namespace
+
+int main() {
+    auto filename = (std::filesystem::temp_directory_path() / "texture_cache_test.tex").string();
+    // 3 x 3 tiles at the full size, down to 1 x 1 texel
+    const size_t width = 3 * TILE_SIZE;
+    const size_t height = 3 * TILE_SIZE - 1;
+    if (!write_texture_file(filename, test_image(width, height), *RGBColorSpace::sRGB(), TILE_SIZE)) {
+        std::cout << "can't write " << filename << std::endl;
+        return 1;
+    }
+    std::vector<MipLevel> levels = mip_map(test_image(width, height));
+
+    size_t n_threads = std::max(4u, std::thread::hardware_concurrency());
+    test_eviction(filename, levels);
+    test_pinning(filename, levels, n_threads);
+    test_concurrent_misses(filename, levels, 4 * n_threads);
+
+    std::filesystem::remove(filename);
+    std::cout << n_failures << " failures" << std::endl;
+    return n_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,142 @@
+#include <algorithm>
+#include <thread>
+
+#include "tiles.hpp"
+
+// if defined, run in multithreaded mode, helpful to disable when debugging
+#define MULTITHREADED
+
+namespace {
+
+// spread the lower 32 bits of v out so that there is a zero between each pair of bits
+uint64_t spread_bits(uint32_t v) {
+    uint64_t x = v;
+    x = (x | (x << 16)) & 0x0000ffff0000ffffull;
+    x = (x | (x << 8)) & 0x00ff00ff00ff00ffull;
+    x = (x | (x << 4)) & 0x0f0f0f0f0f0f0f0full;
+    x = (x | (x << 2)) & 0x3333333333333333ull;
+    x = (x | (x << 1)) & 0x5555555555555555ull;
+    return x;
+}
+
+} // namespace
+
+uint64_t morton_encode(uint32_t x, uint32_t y) {
+    return spread_bits(x) | (spread_bits(y) << 1);
+}
+
+std::vector<Tile> make_tiles(size_t width, size_t height, size_t tile_size) {
+    tile_size = std::max<size_t>(tile_size, 1);
+    size_t n_x = (width + tile_size - 1) / tile_size;
+    size_t n_y = (height + tile_size - 1) / tile_size;
+
+    std::vector<std::pair<uint64_t, Tile>> keyed;
+    keyed.reserve(n_x * n_y);
+    for (size_t ty = 0; ty < n_y; ty++) {
+        for (size_t tx = 0; tx < n_x; tx++) {
+            Tile tile {
+                .x0 = tx * tile_size,
+                .y0 = ty * tile_size,
+                .x1 = std::min((tx + 1) * tile_size, width),
+                .y1 = std::min((ty + 1) * tile_size, height)
+            };
+            keyed.push_back({ morton_encode(tx, ty), tile });
+        }
+    }
+    std::sort(keyed.begin(), keyed.end(), [](const auto& a, const auto& b) {
+        return a.first < b.first;
+    });
+
+    std::vector<Tile> tiles(keyed.size());
+    std::transform(keyed.begin(), keyed.end(), tiles.begin(), [](const auto& kt) {
+        return kt.second;
+    });
+    return tiles;
+}
+
+
+TileScheduler::TileScheduler(std::vector<Tile>&& tiles, size_t n_threads) {
+    n_threads = std::max<size_t>(n_threads, 1);
+    m_queues.reserve(n_threads);
+    for (size_t t = 0; t < n_threads; t++) {
+        m_queues.push_back(std::make_unique<Queue>());
+    }
+    // give each thread a contiguous chunk of the curve, so that neighboring tiles stay on the same thread
+    size_t n_tiles = tiles.size();
+    for (size_t t = 0; t < n_threads; t++) {
+        size_t start = n_tiles * t / n_threads;
+        size_t end = n_tiles * (t + 1) / n_threads;
+        m_queues[t]->tiles.assign(tiles.begin() + start, tiles.begin() + end);
+    }
+}
+
+std::optional<Tile> TileScheduler::pop_front(size_t thread_index) {
+    Queue& queue = *m_queues[thread_index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tiles.empty()) {
+        return std::nullopt;
+    }
+    Tile tile = queue.tiles.front();
+    queue.tiles.pop_front();
+    return tile;
+}
+
+std::optional<Tile> TileScheduler::steal_back(size_t thread_index) {
+    Queue& queue = *m_queues[thread_index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tiles.empty()) {
+        return std::nullopt;
+    }
+    // take from the opposite end from the owner, which is the work furthest from what it's doing now
+    Tile tile = queue.tiles.back();
+    queue.tiles.pop_back();
+    return tile;
+}
+
+std::optional<Tile> TileScheduler::next(size_t thread_index) {
+    auto tile = pop_front(thread_index);
+    if (tile) {
+        return tile;
+    }
+    // own queue is empty; look for work in the other queues, starting with the next thread over
+    // tiles are never added after construction, so a full pass with nothing found means we're done
+    size_t n = m_queues.size();
+    for (size_t i = 1; i < n; i++) {
+        tile = steal_back((thread_index + i) % n);
+        if (tile) {
+            return tile;
+        }
+    }
+    return std::nullopt;
+}
+
+size_t render_thread_count(size_t n_tiles) {
+    #ifdef MULTITHREADED
+    return std::clamp<size_t>(std::thread::hardware_concurrency(), 1, n_tiles);
+    #else
+    return 1;
+    #endif
+}
+
+void render_tiles_parallel(
+    std::vector<Tile>&& tiles,
+    size_t n_threads,
+    const std::function<void(size_t, TileScheduler&)>& render_tiles
+) {
+    n_threads = std::max<size_t>(n_threads, 1);
+    TileScheduler scheduler(std::move(tiles), n_threads);
+    #ifdef MULTITHREADED
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < n_threads; t++) {
+        threads.push_back(std::thread(render_tiles, t, std::ref(scheduler)));
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    #else
+    // Single threaded render, which still gives each thread index its turn
+    for (size_t t = 0; t < n_threads; t++) {
+        render_tiles(t, scheduler);
+    }
+    #endif
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+// a rectangular block of pixels, in image buffer coordinates (row 0 is the top of the image)
+// covers columns [x0, x1) and rows [y0, y1)
+struct Tile {
+    size_t x0;
+    size_t y0;
+    size_t x1;
+    size_t y1;
+
+    size_t area() const {
+        return (x1 - x0) * (y1 - y0);
+    }
+};
+
+// interleave the bits of x and y to get the position of (x, y) along a Morton (Z-order) curve
+uint64_t morton_encode(uint32_t x, uint32_t y);
+
+// split an image into square tiles of the given size, ordered along a Morton curve
+// tiles at the right and bottom edges are clipped to the image
+std::vector<Tile> make_tiles(size_t width, size_t height, size_t tile_size);
+
+// hands out tiles to a fixed number of worker threads
+// each thread has its own queue, which initially holds a contiguous run of tiles along the Morton curve
+// a thread takes tiles from the front of its own queue, and when that is empty,
+// steals from the back of another thread's queue
+class TileScheduler {
+public:
+    TileScheduler(std::vector<Tile>&& tiles, size_t n_threads);
+
+    // get the next tile for the given thread, or nullopt if there is no work left anywhere
+    std::optional<Tile> next(size_t thread_index);
+
+    size_t n_threads() const {
+        return m_queues.size();
+    }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Tile> tiles;
+    };
+
+    std::optional<Tile> pop_front(size_t thread_index);
+    std::optional<Tile> steal_back(size_t thread_index);
+
+    // unique_ptr since mutexes can't be moved
+    std::vector<std::unique_ptr<Queue>> m_queues;
+};
+
+// how many threads to render the given number of tiles on: one per core, but no more than there are tiles
+size_t render_thread_count(size_t n_tiles);
+
+// share tiles between n_threads threads through a TileScheduler, and wait for them to finish
+// render_tiles(thread_index, scheduler) runs once on each thread, and should render the tiles scheduler.next gives
+// it until there are none left
+void render_tiles_parallel(
+    std::vector<Tile>&& tiles,
+    size_t n_threads,
+    const std::function<void(size_t, TileScheduler&)>& render_tiles
+);
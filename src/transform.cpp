@@ -194,6 +194,15 @@ Ray Transform::apply_inverse(const Ray& r) const {
     return Ray(m_inv_mat * r.o, m_inv_mat * r.d);
 }
 
+Vec3 Transform::apply_normal(const Vec3& n) const {
+    const auto& m = m_inv_mat.data;
+    return Vec3(
+        m[0] * n.x + m[4] * n.y + m[8] * n.z,
+        m[1] * n.x + m[5] * n.y + m[9] * n.z,
+        m[2] * n.x + m[6] * n.y + m[10] * n.z
+    );
+}
+
 Transform Transform::apply(const Transform& t) const {
     return Transform(m_mat * t.m_mat, t.m_inv_mat * m_inv_mat);
 }
@@ -83,6 +83,10 @@ public:
     Pt3 apply_inverse(const Pt3& v) const;
     Ray apply_inverse(const Ray& r) const;
 
+    // surface normals transform by the inverse transpose, so they stay perpendicular to the surface
+    // the result isn't normalized
+    Vec3 apply_normal(const Vec3& n) const;
+
     Transform apply(const Transform& t) const;
 
     template <typename T>
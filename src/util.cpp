@@ -1,5 +1,61 @@
+#include <cstring>
+
 #include "util.hpp"
 
 float lerp(float a, float b, float t) {
     return a + t * (b - a);
-}
\ No newline at end of file
+}
+
+// MurmurHash64A, by Austin Appleby
+uint64_t hash_bytes(const void* data, size_t size, uint64_t seed) {
+    const unsigned char* key = static_cast<const unsigned char*>(data);
+    const uint64_t m = 0xc6a4a7935bd1e995ull;
+    const int r = 47;
+
+    uint64_t h = seed ^ (size * m);
+
+    const unsigned char* end = key + 8 * (size / 8);
+
+    while (key != end) {
+        uint64_t k;
+        std::memcpy(&k, key, sizeof(uint64_t));
+        key += 8;
+
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+
+        h ^= k;
+        h *= m;
+    }
+
+    switch (size & 7) {
+    case 7:
+        h ^= uint64_t(key[6]) << 48;
+        [[fallthrough]];
+    case 6:
+        h ^= uint64_t(key[5]) << 40;
+        [[fallthrough]];
+    case 5:
+        h ^= uint64_t(key[4]) << 32;
+        [[fallthrough]];
+    case 4:
+        h ^= uint64_t(key[3]) << 24;
+        [[fallthrough]];
+    case 3:
+        h ^= uint64_t(key[2]) << 16;
+        [[fallthrough]];
+    case 2:
+        h ^= uint64_t(key[1]) << 8;
+        [[fallthrough]];
+    case 1:
+        h ^= uint64_t(key[0]);
+        h *= m;
+    };
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+
+    return h;
+}
@@ -1,5 +1,11 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+
 const float ONE_MINUS_EPS = float(0x1.fffffep-1);
 
-float lerp(float a, float b, float t);
\ No newline at end of file
+float lerp(float a, float b, float t);
+
+// a fast, non-cryptographic 64-bit hash (MurmurHash64A), for keying caches by content and scrambling samples
+uint64_t hash_bytes(const void* data, size_t size, uint64_t seed = 0);
@@ -0,0 +1,393 @@
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "color/color.hpp"
+#include "integrator.hpp"
+#include "progress.hpp"
+#include "render.hpp"
+#include "tiles.hpp"
+
+// roughly how many paths are traced together in a single wave
+const size_t WAVE_SIZE = 1 << 14;
+
+// the state of every path in a wave, stored as one array per field
+struct PathStates {
+    // index of the path's pixel within the current tile
+    std::vector<size_t> pixel;
+    std::vector<Ray> ray;
+    std::vector<SpectrumSample> weight;
+    std::vector<WavelengthSample> wavelengths;
+    std::vector<SamplerState> sampler_state;
+    std::vector<PixelSample> result;
+    std::vector<size_t> depth;
+    std::vector<char> specular_bounce;
+    std::vector<float> p_b;
+    std::vector<float> ior_scale;
+    std::vector<Pt3> last_p;
+    std::vector<Vec3> last_normal;
+
+    void resize(size_t n) {
+        pixel.resize(n);
+        ray.resize(n);
+        weight.resize(n);
+        wavelengths.resize(n);
+        sampler_state.resize(n);
+        result.resize(n);
+        depth.resize(n);
+        specular_bounce.resize(n);
+        p_b.resize(n);
+        ior_scale.resize(n);
+        last_p.resize(n);
+        last_normal.resize(n);
+    }
+};
+
+// traces the paths for one tile at a time, advancing every path in a wave by one bounce per iteration
+// each stage (intersection, shading, shadow rays) runs over the whole wave before the next starts,
+// so rays can be traced in packets and shading can be grouped by material
+class Wavefront {
+public:
+    Wavefront(
+        const Camera& camera,
+        const Scene& scene,
+        Sampler& sampler,
+        size_t max_bounces
+    ) : m_camera(camera), m_scene(scene), m_sampler(sampler), m_max_bounces(max_bounces) {}
+
+    void render_tile(const Tile& tile, size_t n_samples, RenderResult& result);
+
+private:
+    void generate(const Tile& tile, size_t sample_start, size_t sample_end);
+    void intersect(bool coherent);
+    void shade();
+    void trace_shadow_rays();
+    void accumulate();
+
+    const Camera& m_camera;
+    const Scene& m_scene;
+    Sampler& m_sampler;
+    size_t m_max_bounces;
+    // for the BxDF of the path being shaded, reset after each one
+    Arena m_arena;
+
+    PathStates m_paths;
+    // indices of paths that are still being traced
+    std::vector<size_t> m_active;
+    std::vector<size_t> m_next_active;
+
+    // intersection stage; entries line up with m_active
+    std::vector<Ray> m_rays;
+    std::vector<std::optional<SurfaceInteraction>> m_interactions;
+
+    // positions in m_active of paths that need their bsdf sampled this bounce
+    std::vector<size_t> m_shade_queue;
+
+    // shadow rays queued during shading
+    std::vector<size_t> m_shadow_paths;
+    std::vector<SpectrumSample> m_shadow_specs;
+    std::vector<std::pair<Pt3, Pt3>> m_shadow_segments;
+    std::vector<char> m_shadow_occluded;
+
+    // per-pixel sums for the current tile
+    std::vector<RGB> m_color;
+    std::vector<Vec3> m_normal;
+    std::vector<RGB> m_albedo;
+};
+
+void Wavefront::generate(const Tile& tile, size_t sample_start, size_t sample_end) {
+    size_t tile_width = tile.x1 - tile.x0;
+    size_t n_paths = tile.area() * (sample_end - sample_start);
+    m_paths.resize(n_paths);
+    m_active.clear();
+
+    size_t j = 0;
+    for (size_t p = 0; p < tile.area(); p++) {
+        size_t x = tile.x0 + p % tile_width;
+        size_t row = tile.y0 + p / tile_width;
+        size_t y = m_camera.image_height - row - 1;
+        for (size_t s = sample_start; s < sample_end; s++, j++) {
+            m_sampler.start_pixel_sample(x, y, s);
+            auto jitter = m_sampler.sample_pixel();
+            m_paths.ray[j] = m_camera.cast_ray(float(x) + jitter.x, float(y) + jitter.y);
+            m_paths.wavelengths[j] = WavelengthSample::sample(m_scene.color_mode(), m_sampler.sample_1d());
+            m_paths.sampler_state[j] = m_sampler.state();
+
+            m_paths.pixel[j] = p;
+            m_paths.weight[j] = SpectrumSample(1.0f);
+            m_paths.result[j] = PixelSample();
+            m_paths.depth[j] = 0;
+            m_paths.specular_bounce[j] = false;
+            m_paths.p_b[j] = 1.0f;
+            m_paths.ior_scale[j] = 1.0f;
+            m_active.push_back(j);
+        }
+    }
+}
+
+void Wavefront::intersect(bool coherent) {
+    m_rays.resize(m_active.size());
+    for (size_t k = 0; k < m_active.size(); k++) {
+        m_rays[k] = m_paths.ray[m_active[k]];
+    }
+    m_scene.ray_intersect(m_rays, m_interactions, coherent);
+    // textures seen directly are filtered over the pixel; later hits get their finest detail
+    for (size_t k = 0; k < m_active.size(); k++) {
+        if (m_interactions[k] && m_paths.depth[m_active[k]] == 0) {
+            m_interactions[k]->compute_differentials(m_camera.differentials(m_rays[k]));
+        }
+    }
+}
+
+void Wavefront::shade() {
+    m_next_active.clear();
+    m_shade_queue.clear();
+    m_shadow_paths.clear();
+    m_shadow_specs.clear();
+    m_shadow_segments.clear();
+
+    // first handle everything that doesn't need a bsdf: misses, emission, and termination
+    for (size_t k = 0; k < m_active.size(); k++) {
+        size_t j = m_active[k];
+        const auto& si = m_interactions[k];
+        const Ray& ray = m_paths.ray[j];
+        const WavelengthSample& wavelengths = m_paths.wavelengths[j];
+        PixelSample& pxs = m_paths.result[j];
+        const SpectrumSample& weight = m_paths.weight[j];
+        size_t depth = m_paths.depth[j];
+
+        // no intersection, add background and finish the path
+        if (!si) {
+            auto bg_light = m_scene.get_bg_light();
+            if (bg_light.spectrum) {
+                pxs.color += weight * bg_light.emission(wavelengths);
+            }
+            continue;
+        }
+        if (depth == 0) {
+            pxs.normal = si->normal;
+        }
+        // add emitted light if intersected object is an area light
+        auto emitted = si->emission(-ray.d, wavelengths);
+        if (!emitted.is_zero()) {
+            if (depth == 0 || m_paths.specular_bounce[j]) {
+                pxs.color += weight * emitted;
+            }
+            else {
+                // compute importance-sampled weight for area light
+                auto light = si->light;
+                float light_proba = m_scene.light_sample_pmf(m_paths.last_p[j], m_paths.last_normal[j], light)
+                    * light->pdf(m_paths.last_p[j], ray.d);
+                float light_weight = power_heuristic(1, m_paths.p_b[j], 1, light_proba);
+
+                pxs.color += emitted * (weight * light_weight);
+            }
+        }
+        if (depth == m_max_bounces) {
+            continue;
+        }
+        m_shade_queue.push_back(k);
+    }
+
+    // group the remaining paths by material so that consecutive shading calls run the same code on the same data
+    std::sort(m_shade_queue.begin(), m_shade_queue.end(), [this](size_t a, size_t b) {
+        const Material* ma = m_interactions[a]->material;
+        const Material* mb = m_interactions[b]->material;
+        return ma != mb ? std::less<const Material*>()(ma, mb) : a < b;
+    });
+
+    for (size_t k : m_shade_queue) {
+        size_t j = m_active[k];
+        const SurfaceInteraction& si = *m_interactions[k];
+        WavelengthSample& wavelengths = m_paths.wavelengths[j];
+        PixelSample& pxs = m_paths.result[j];
+        SpectrumSample& weight = m_paths.weight[j];
+        m_sampler.set_state(m_paths.sampler_state[j]);
+
+        m_arena.reset();
+        auto bsdf = si.bsdf(m_paths.ray[j], wavelengths, m_sampler.sample_1d(), m_arena, m_scene.material_dispatch());
+        if (!bsdf) {
+            // pass straight through surfaces with no material, having drawn the same samples as sample_pixel does
+            m_paths.specular_bounce[j] = true;
+            m_paths.ray[j] = si.skip_intersection(m_paths.ray[j]);
+            m_paths.sampler_state[j] = m_sampler.state();
+            m_next_active.push_back(j);
+            continue;
+        }
+
+        if (m_paths.depth[j] == 0) {
+            pxs.albedo = sample_albedo(si, *bsdf);
+        }
+
+        if (!bsdf->is_specular()) {
+            // queue a shadow ray for direct illumination; it's resolved after shading is done
+            auto uls = sample_lights_unoccluded(m_scene, si, *bsdf, wavelengths, m_sampler);
+            if (uls) {
+                m_shadow_paths.push_back(j);
+                m_shadow_specs.push_back(weight * uls->spec);
+                m_shadow_segments.push_back({ uls->start, uls->end });
+            }
+        }
+
+        auto bsdf_sample = bsdf->sample(si.wo, m_sampler.sample_1d(), m_sampler.sample_2d());
+        if (!bsdf_sample) {
+            continue;
+        }
+
+        weight *= bsdf_sample->spec * std::abs(bsdf_sample->wi.dot(si.normal)) / bsdf_sample->pdf;
+
+        m_paths.p_b[j] = bsdf_sample->pdf_is_proportional ? bsdf->pdf(si.wo, bsdf_sample->wi) : bsdf_sample->pdf;
+        m_paths.specular_bounce[j] = bsdf_sample->scatter_type.specular;
+        if (bsdf_sample->scatter_type.transmission) {
+            m_paths.ior_scale[j] *= bsdf_sample->ior;
+        }
+        m_paths.last_p[j] = si.point;
+        m_paths.last_normal[j] = si.normal;
+
+        m_paths.ray[j] = Ray(si.point, bsdf_sample->wi);
+        m_paths.depth[j]++;
+
+        // maybe terminate early (russian roulette)
+        float roulette_sample = m_sampler.sample_1d();
+        m_paths.sampler_state[j] = m_sampler.state();
+        auto rr_weight = weight * m_paths.ior_scale[j];
+        if (rr_weight.max_component() < 1.f && m_paths.depth[j] > 1) {
+            float q = std::max(0.0f, 1.0f - rr_weight.max_component());
+            if (roulette_sample < q) {
+                continue;
+            }
+            weight /= 1.0f - q;
+        }
+        if (weight.is_zero()) {
+            continue;
+        }
+        m_next_active.push_back(j);
+    }
+
+    // keep paths in pixel order so that the next round of rays stays coherent
+    std::sort(m_next_active.begin(), m_next_active.end());
+    std::swap(m_active, m_next_active);
+}
+
+void Wavefront::trace_shadow_rays() {
+    m_scene.occluded(m_shadow_segments, m_shadow_occluded);
+    for (size_t i = 0; i < m_shadow_paths.size(); i++) {
+        if (!m_shadow_occluded[i]) {
+            m_paths.result[m_shadow_paths[i]].color += m_shadow_specs[i];
+        }
+    }
+}
+
+void Wavefront::accumulate() {
+    for (size_t j = 0; j < m_paths.pixel.size(); j++) {
+        size_t p = m_paths.pixel[j];
+        const PixelSample& pxs = m_paths.result[j];
+        const WavelengthSample& wavelengths = m_paths.wavelengths[j];
+        m_color[p] += m_camera.sensor.to_sensor_rgb(pxs.color, wavelengths);
+        m_albedo[p] += m_camera.sensor.to_sensor_rgb(pxs.albedo, wavelengths);
+        m_normal[p] += pxs.normal;
+    }
+}
+
+void Wavefront::render_tile(const Tile& tile, size_t n_samples, RenderResult& result) {
+    m_color.assign(tile.area(), RGB());
+    m_normal.assign(tile.area(), Vec3());
+    m_albedo.assign(tile.area(), RGB());
+
+    // split the samples for this tile into waves of around WAVE_SIZE paths
+    size_t wave_samples = std::clamp<size_t>(WAVE_SIZE / tile.area(), 1, n_samples);
+    for (size_t s = 0; s < n_samples; s += wave_samples) {
+        generate(tile, s, std::min(s + wave_samples, n_samples));
+        // only the camera rays of the first bounce are coherent enough to benefit from packet traversal
+        for (size_t bounce = 0; !m_active.empty(); bounce++) {
+            intersect(bounce == 0);
+            shade();
+            trace_shadow_rays();
+        }
+        accumulate();
+    }
+
+    size_t tile_width = tile.x1 - tile.x0;
+    for (size_t p = 0; p < tile.area(); p++) {
+        size_t i = (tile.y0 + p / tile_width) * m_camera.image_width + tile.x0 + p % tile_width;
+        RGB color(m_color[p] / float(n_samples));
+        Vec3 normal = m_normal[p] / float(n_samples);
+        RGB albedo(m_albedo[p] / float(n_samples));
+
+        result.color_buffer[i * 3 + 0] = color.x;
+        result.color_buffer[i * 3 + 1] = color.y;
+        result.color_buffer[i * 3 + 2] = color.z;
+
+        result.normal_buffer[i * 3 + 0] = normal.x;
+        result.normal_buffer[i * 3 + 1] = normal.y;
+        result.normal_buffer[i * 3 + 2] = normal.z;
+
+        result.albedo_buffer[i * 3 + 0] = albedo.x;
+        result.albedo_buffer[i * 3 + 1] = albedo.y;
+        result.albedo_buffer[i * 3 + 2] = albedo.z;
+    }
+}
+
+void render_tiles_wavefront(
+    const Camera& camera,
+    const Scene& scene,
+    Sampler& sampler,
+    size_t n_samples,
+    size_t max_bounces,
+    RenderResult& result,
+    TileScheduler& scheduler,
+    size_t thread_index,
+    ProgressBar& progress_bar
+) {
+    Wavefront wavefront(camera, scene, sampler, max_bounces);
+    while (auto tile = scheduler.next(thread_index)) {
+        wavefront.render_tile(*tile, n_samples, result);
+        progress_bar.increment(tile->area());
+    }
+}
+
+RenderResult render_wavefront(
+    const Camera& camera,
+    const Scene& scene,
+    size_t n_samples,
+    size_t max_bounces,
+    size_t tile_size
+) {
+    RenderResult result(camera.image_height, camera.image_width);
+    if (!scene.ready()) {
+        std::cout << "Scene must be committed before rendering." << std::endl;
+        return result;
+    }
+    n_samples = std::max<size_t>(n_samples, 1);
+
+    size_t image_size = result.width * result.height;
+    Sampler sampler(n_samples, camera.image_width, camera.image_height, 0);
+
+    ProgressBar progress_bar { .total = image_size };
+    auto start_time = std::chrono::steady_clock::now();
+
+    auto tiles = make_tiles(camera.image_width, camera.image_height, tile_size);
+
+    size_t n_threads = render_thread_count(tiles.size());
+    std::cout << "Rendering with " << n_threads << " threads" << std::endl;
+
+    // make a copy of the sampler for each thread
+    std::vector<Sampler> samplers;
+    samplers.reserve(n_threads);
+    for (size_t t = 0; t < n_threads; t++) {
+        samplers.push_back(sampler);
+    }
+
+    render_tiles_parallel(std::move(tiles), n_threads, [&](size_t t, TileScheduler& scheduler) {
+        render_tiles_wavefront(camera, scene, samplers[t], n_samples, max_bounces, result, scheduler, t, progress_bar);
+    });
+
+    auto end_time = std::chrono::steady_clock::now();
+    std::chrono::duration<float> duration = end_time - start_time;
+    std::cout << std::endl << "Render time: " << std::fixed << std::setprecision(3) <<duration << std::endl;
+
+    return result;
+}